@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <random>
+#include <type_traits>
+
+namespace Tree {
+
+   /// Sums of integral keys are kept in the widest integer of the same signedness, so a sum of
+   /// many keys doesn't overflow the key type
+   template <class Key>
+   using WideSum = typename std::conditional<!std::is_integral<Key>::value, Key,
+                                             typename std::conditional<std::is_signed<Key>::value, long long,
+                                                                       unsigned long long>::type>::type;
+
+   /// Monoids for AugmentedTree: identity, value of one key and associative combination of values
+   /// of two adjacent ranges (left one first).
+   template <class Key, class Sum = WideSum<Key>>
+   struct SumMonoid
+   {
+      using Value = Sum;
+
+      static Value identity() { return Value(); }
+      static Value lift(const Key &k) { return Value(k); }
+      static Value combine(const Value &l, const Value &r) { return l + r; }
+   };
+
+   template <class Key>
+   struct MinMonoid
+   {
+      using Value = Key;
+
+      static Value identity() { return std::numeric_limits<Key>::max(); }
+      static Value lift(const Key &k) { return k; }
+      static Value combine(const Value &l, const Value &r) { return std::min(l, r); }
+   };
+
+   template <class Key>
+   struct MaxMonoid
+   {
+      using Value = Key;
+
+      static Value identity() { return std::numeric_limits<Key>::lowest(); }
+      static Value lift(const Key &k) { return k; }
+      static Value combine(const Value &l, const Value &r) { return std::max(l, r); }
+   };
+
+   template <class Key>
+   struct CountMonoid
+   {
+      using Value = std::size_t;
+
+      static Value identity() { return 0; }
+      static Value lift(const Key &) { return 1; }
+      static Value combine(const Value &l, const Value &r) { return l + r; }
+   };
+
+   /// Ordered multiset where every node keeps the aggregate of its subtree. Balanced as a treap,
+   /// rotations recompute aggregates of two nodes only, so insert and erase are O(log n). An
+   /// aggregate over any range of keys is combined from O(log n) subtrees.
+   template <class Key, class Monoid = SumMonoid<Key>>
+   class AugmentedTree
+   {
+   public:
+      using Value = typename Monoid::Value;
+
+   private:
+      struct ANode;
+      using Ptr = std::unique_ptr<ANode>;
+
+      struct ANode
+      {
+         ANode(const Key &k, std::uint32_t p) : mKey(k), mPriority(p), mValue(Monoid::lift(k)) {}
+
+         Ptr mLeftChild;
+         Ptr mRightChild;
+         Key mKey;
+         std::uint32_t mPriority;
+         std::size_t mSize = 1;
+         Value mValue;
+      };
+
+   public:
+      explicit AugmentedTree(std::uint32_t seed = 5489u) : mGenerator(seed) {}
+
+      std::size_t size() const { return mRoot ? mRoot->mSize : 0; }
+      bool empty() const { return !mRoot; }
+
+      /// Aggregate of the whole tree
+      Value total() const { return value(mRoot); }
+
+      void insert(const Key &k) { insertImpl(mRoot, k, mGenerator()); }
+
+      /// Removes one occurrence of the key, returns false if there is no such key
+      bool erase(const Key &k) { return eraseImpl(mRoot, k); }
+
+      /// Aggregate of all keys in [lo, hi] in the key order
+      Value aggregate(const Key &lo, const Key &hi) const
+      {
+         // The highest node in the range, everything in the range is in its subtree
+         const ANode *split = mRoot.get();
+         while (split && (split->mKey < lo || hi < split->mKey))
+            split = split->mKey < lo ? split->mRightChild.get() : split->mLeftChild.get();
+
+         if (!split)
+            return Monoid::identity();
+
+         // Left of the split: the node and its right subtree are in the range if the key is not less than lo
+         Value left = Monoid::identity();
+         for (const ANode *n = split->mLeftChild.get(); n; ) {
+            if (!(n->mKey < lo)) {
+               left = Monoid::combine(Monoid::combine(Monoid::lift(n->mKey), value(n->mRightChild)), left);
+               n = n->mLeftChild.get();
+            } else
+               n = n->mRightChild.get();
+         }
+
+         // Right of the split is symmetric
+         Value right = Monoid::identity();
+         for (const ANode *n = split->mRightChild.get(); n; ) {
+            if (!(hi < n->mKey)) {
+               right = Monoid::combine(right, Monoid::combine(value(n->mLeftChild), Monoid::lift(n->mKey)));
+               n = n->mRightChild.get();
+            } else
+               n = n->mLeftChild.get();
+         }
+
+         return Monoid::combine(Monoid::combine(left, Monoid::lift(split->mKey)), right);
+      }
+
+      /// In-order traversal
+      template <class F>
+      void forEach(F &&f) const { forEachImpl(mRoot.get(), f); }
+
+   private:
+      static Value value(const Ptr &node) { return node ? node->mValue : Monoid::identity(); }
+      static std::size_t sizeOf(const Ptr &node) { return node ? node->mSize : 0; }
+
+      static void update(ANode &node)
+      {
+         node.mSize = sizeOf(node.mLeftChild) + 1 + sizeOf(node.mRightChild);
+         node.mValue = Monoid::combine(Monoid::combine(value(node.mLeftChild), Monoid::lift(node.mKey)),
+                                       value(node.mRightChild));
+      }
+
+      // Left child becomes the root of the subtree, the old root is updated first as it is lower now
+      static void rotateRight(Ptr &node)
+      {
+         Ptr l = std::move(node->mLeftChild);
+         node->mLeftChild = std::move(l->mRightChild);
+         update(*node);
+         l->mRightChild = std::move(node);
+         update(*l);
+         node = std::move(l);
+      }
+
+      static void rotateLeft(Ptr &node)
+      {
+         Ptr r = std::move(node->mRightChild);
+         node->mRightChild = std::move(r->mLeftChild);
+         update(*node);
+         r->mLeftChild = std::move(node);
+         update(*r);
+         node = std::move(r);
+      }
+
+      static void insertImpl(Ptr &node, const Key &k, std::uint32_t priority)
+      {
+         if (!node) {
+            node.reset(new ANode(k, priority));
+            return;
+         }
+
+         // Equal keys go to the left, as for Node::insertInOrder
+         if (!(node->mKey < k)) {
+            insertImpl(node->mLeftChild, k, priority);
+            if (node->mLeftChild->mPriority > node->mPriority)
+               return rotateRight(node);
+         } else {
+            insertImpl(node->mRightChild, k, priority);
+            if (node->mRightChild->mPriority > node->mPriority)
+               return rotateLeft(node);
+         }
+
+         update(*node);
+      }
+
+      static bool eraseImpl(Ptr &node, const Key &k)
+      {
+         if (!node)
+            return false;
+
+         bool erased = true;
+         if (k < node->mKey)
+            erased = eraseImpl(node->mLeftChild, k);
+         else if (node->mKey < k)
+            erased = eraseImpl(node->mRightChild, k);
+         else if (!node->mLeftChild || !node->mRightChild) {
+            node = std::move(node->mLeftChild ? node->mLeftChild : node->mRightChild);
+            return true;
+         } else if (node->mLeftChild->mPriority > node->mRightChild->mPriority) {
+            // Rotate the node down until it has one child
+            rotateRight(node);
+            erased = eraseImpl(node->mRightChild, k);
+         } else {
+            rotateLeft(node);
+            erased = eraseImpl(node->mLeftChild, k);
+         }
+
+         if (erased)
+            update(*node);
+         return erased;
+      }
+
+      template <class F>
+      static void forEachImpl(const ANode *node, F &f)
+      {
+         if (!node)
+            return;
+
+         forEachImpl(node->mLeftChild.get(), f);
+         f(node->mKey);
+         forEachImpl(node->mRightChild.get(), f);
+      }
+
+      Ptr mRoot;
+      std::minstd_rand mGenerator;
+   };
+
+   using IntSumTree = AugmentedTree<int, SumMonoid<int>>;
+   using IntMinTree = AugmentedTree<int, MinMonoid<int>>;
+   using IntMaxTree = AugmentedTree<int, MaxMonoid<int>>;
+
+} // namespace Tree
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <cassert>
+#include <cstdlib>
+#include <iterator>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace Tree {
+
+   namespace details {
+
+      static const std::size_t CACHE_LINE = 64;
+
+      template <class T, class... Args>
+      T *createAligned(Args&&... args)
+      {
+         void *p = nullptr;
+         if (posix_memalign(&p, CACHE_LINE, sizeof(T)) != 0)
+            throw std::bad_alloc();
+         return new (p) T(std::forward<Args>(args)...);
+      }
+
+      template <class T>
+      void destroyAligned(T *p)
+      {
+         p->~T();
+         free(p);
+      }
+
+      /// Number of keys less than k, branchless, so compiler can vectorize it
+      template <class Key>
+      int countLess(const Key *keys, int n, const Key &k)
+      {
+         int count = 0;
+         for (int i = 0; i < n; ++i)
+            count += keys[i] < k;
+         return count;
+      }
+
+      /// Number of keys less or equal to k
+      template <class Key>
+      int countLessEqual(const Key *keys, int n, const Key &k)
+      {
+         int count = 0;
+         for (int i = 0; i < n; ++i)
+            count += !(k < keys[i]);
+         return count;
+      }
+
+#ifdef __SSE2__
+      inline int horizontalSum(__m128i v)
+      {
+         v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+         v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+         return _mm_cvtsi128_si32(v);
+      }
+
+      /// Compares four keys at once, every matched lane is -1, so it's subtracted from the counter
+      inline int countGreaterMask(const int *keys, int n, __m128i lhs, bool keysOnLeft, int &i)
+      {
+         __m128i counter = _mm_setzero_si128();
+         for (i = 0; i + 4 <= n; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+            counter = _mm_sub_epi32(counter, keysOnLeft ? _mm_cmpgt_epi32(v, lhs) : _mm_cmpgt_epi32(lhs, v));
+         }
+         return horizontalSum(counter);
+      }
+
+      inline int countLess(const int *keys, int n, const int &k)
+      {
+         int i = 0;
+         int count = countGreaterMask(keys, n, _mm_set1_epi32(k), false /*keysOnLeft*/, i);
+         for (; i < n; ++i)
+            count += keys[i] < k;
+         return count;
+      }
+
+      inline int countLessEqual(const int *keys, int n, const int &k)
+      {
+         int i = 0;
+         int greater = countGreaterMask(keys, n, _mm_set1_epi32(k), true /*keysOnLeft*/, i);
+         for (; i < n; ++i)
+            greater += keys[i] > k;
+         return n - greater;
+      }
+#endif
+
+   } // namespace details
+
+   /// Ordered multiset with leaves of NodeBytes size (one to four cache lines). Inner nodes keep
+   /// sizes of subtrees for random selection, so they are at least as large as needed for four
+   /// children, e.g. two cache lines for int keys. Leaves are linked for scans.
+   template <class Key, std::size_t NodeBytes = 256>
+   class BPlusTree
+   {
+      struct Leaf
+      {
+         static const int CAPACITY = int((NodeBytes - 2 * sizeof(void *) - sizeof(int)) / sizeof(Key));
+
+         Leaf *prev = nullptr;
+         Leaf *next = nullptr;
+         int count = 0;
+         Key keys[CAPACITY];
+      };
+
+      struct Inner
+      {
+         static const std::size_t CHILD_BYTES = sizeof(Key) + sizeof(void *) + sizeof(std::size_t);
+         static const std::size_t MIN_BYTES =
+            (sizeof(int) - sizeof(Key) + 4 * CHILD_BYTES + details::CACHE_LINE - 1) / details::CACHE_LINE * details::CACHE_LINE;
+         static const std::size_t BYTES = NodeBytes < MIN_BYTES ? MIN_BYTES : NodeBytes;
+         static const int CAPACITY = int((BYTES - sizeof(int) + sizeof(Key)) / CHILD_BYTES);
+
+         int count = 0; // of children
+         Key keys[CAPACITY - 1]; // keys[i] is the first key of children[i + 1]
+         void *children[CAPACITY];
+         std::size_t sizes[CAPACITY];
+      };
+
+      static_assert(Leaf::CAPACITY >= 4, "Node size is too small for four keys in a leaf.");
+
+   public:
+      class Iterator
+      {
+      public:
+         using iterator_category = std::bidirectional_iterator_tag;
+         using value_type        = Key;
+         using difference_type   = std::ptrdiff_t;
+         using pointer           = const Key *;
+         using reference         = const Key &;
+
+         Iterator() {}
+
+         reference operator *() const { return mLeaf->keys[mIndex]; }
+         pointer operator ->() const { return &mLeaf->keys[mIndex]; }
+
+         Iterator &operator ++()
+         {
+            if (++mIndex == mLeaf->count && mLeaf->next) {
+               mLeaf = mLeaf->next;
+               mIndex = 0;
+            }
+            return *this;
+         }
+
+         Iterator &operator --()
+         {
+            if (mIndex == 0 && mLeaf->prev) {
+               mLeaf = mLeaf->prev;
+               mIndex = mLeaf->count;
+            }
+            --mIndex;
+            return *this;
+         }
+
+         Iterator operator ++(int) { auto tmp = *this; ++*this; return tmp; }
+         Iterator operator --(int) { auto tmp = *this; --*this; return tmp; }
+
+         bool operator ==(const Iterator &other) const { return mLeaf == other.mLeaf && mIndex == other.mIndex; }
+         bool operator !=(const Iterator &other) const { return !(*this == other); }
+
+      private:
+         friend class BPlusTree;
+         Iterator(Leaf *leaf, int index) : mLeaf(leaf), mIndex(index) {}
+
+         Leaf *mLeaf = nullptr;
+         int mIndex = 0;
+      };
+
+      BPlusTree() : mRoot(details::createAligned<Leaf>()), mLastLeaf(static_cast<Leaf *>(mRoot)) {}
+      ~BPlusTree() { destroy(mRoot, mHeight); }
+
+      BPlusTree(const BPlusTree &) = delete;
+      BPlusTree &operator =(const BPlusTree &) = delete;
+
+      static constexpr int leafCapacity()  { return Leaf::CAPACITY; }
+      static constexpr int innerCapacity() { return Inner::CAPACITY; }
+
+      std::size_t size() const { return mSize; }
+      bool empty() const { return mSize == 0; }
+      int height() const { return mHeight; }
+
+      Iterator begin() const { return Iterator(leftmostLeaf(), 0); }
+      /// End is the position after the last key of the last leaf, so decrementing it works
+      Iterator end() const { return Iterator(mLastLeaf, mLastLeaf->count); }
+
+      Iterator insert(const Key &k)
+      {
+         Split split = insertImpl(mRoot, mHeight, k);
+         ++mSize;
+
+         if (split.right) {
+            auto root = details::createAligned<Inner>();
+            root->count = 2;
+            root->children[0] = mRoot;
+            root->children[1] = split.right;
+            root->keys[0] = split.key;
+            root->sizes[0] = mSize - split.rightSize;
+            root->sizes[1] = split.rightSize;
+
+            mRoot = root;
+            ++mHeight;
+         }
+
+         return find(k);
+      }
+
+      Iterator find(const Key &k) const
+      {
+         Iterator it = lowerBound(k);
+         return it != end() && !(k < *it) ? it : end();
+      }
+
+      /// First key not less than k
+      Iterator lowerBound(const Key &k) const
+      {
+         void *node = mRoot;
+         for (int level = mHeight; level > 0; --level) {
+            auto inner = static_cast<Inner *>(node);
+            node = inner->children[details::countLess(inner->keys, inner->count - 1, k)];
+         }
+
+         return normalize(static_cast<Leaf *>(node), details::countLess(static_cast<Leaf *>(node)->keys,
+                                                                        static_cast<Leaf *>(node)->count, k));
+      }
+
+      /// First key greater than k
+      Iterator upperBound(const Key &k) const
+      {
+         void *node = mRoot;
+         for (int level = mHeight; level > 0; --level) {
+            auto inner = static_cast<Inner *>(node);
+            node = inner->children[details::countLessEqual(inner->keys, inner->count - 1, k)];
+         }
+
+         auto leaf = static_cast<Leaf *>(node);
+         return normalize(leaf, details::countLessEqual(leaf->keys, leaf->count, k));
+      }
+
+      Iterator successor(Iterator it) const { return ++it; }
+
+      /// Uniformly chosen key, O(height)
+      template <class Generator>
+      Iterator randomNode(Generator &generator) const
+      {
+         if (empty())
+            throw std::logic_error("Cannot give you a random node.");
+
+         std::size_t index = std::uniform_int_distribution<std::size_t>(0, mSize - 1)(generator);
+
+         void *node = mRoot;
+         for (int level = mHeight; level > 0; --level) {
+            auto inner = static_cast<Inner *>(node);
+            int child = 0;
+            while (index >= inner->sizes[child])
+               index -= inner->sizes[child++];
+            node = inner->children[child];
+         }
+
+         return Iterator(static_cast<Leaf *>(node), int(index));
+      }
+
+   private:
+      struct Split
+      {
+         void *right = nullptr;
+         Key key {};
+         std::size_t rightSize = 0;
+      };
+
+      Leaf *leftmostLeaf() const
+      {
+         void *node = mRoot;
+         for (int level = mHeight; level > 0; --level)
+            node = static_cast<Inner *>(node)->children[0];
+         return static_cast<Leaf *>(node);
+      }
+
+      /// Position after the last key of a leaf is the first key of the next one
+      Iterator normalize(Leaf *leaf, int index) const
+      {
+         if (index == leaf->count && leaf->next)
+            return Iterator(leaf->next, 0);
+         return Iterator(leaf, index);
+      }
+
+      Split insertImpl(void *node, int level, const Key &k)
+      {
+         if (level == 0)
+            return insertIntoLeaf(static_cast<Leaf *>(node), k);
+
+         auto inner = static_cast<Inner *>(node);
+         int child = details::countLessEqual(inner->keys, inner->count - 1, k);
+
+         Split split = insertImpl(inner->children[child], level - 1, k);
+         ++inner->sizes[child];
+         if (!split.right)
+            return Split();
+
+         inner->sizes[child] -= split.rightSize;
+
+         // Make a gap for the new child
+         for (int i = inner->count; i > child + 1; --i) {
+            inner->children[i] = inner->children[i - 1];
+            inner->sizes[i] = inner->sizes[i - 1];
+            inner->keys[i - 1] = inner->keys[i - 2];
+         }
+         inner->children[child + 1] = split.right;
+         inner->sizes[child + 1] = split.rightSize;
+         inner->keys[child] = split.key;
+         ++inner->count;
+
+         if (inner->count < Inner::CAPACITY)
+            return Split();
+
+         // Full node is split in halves, middle key goes to the parent
+         auto right = details::createAligned<Inner>();
+         const int leftCount = inner->count / 2;
+         right->count = inner->count - leftCount;
+
+         Split result;
+         result.right = right;
+         result.key = inner->keys[leftCount - 1];
+         for (int i = 0; i < right->count; ++i) {
+            right->children[i] = inner->children[leftCount + i];
+            right->sizes[i] = inner->sizes[leftCount + i];
+            result.rightSize += right->sizes[i];
+            if (i > 0)
+               right->keys[i - 1] = inner->keys[leftCount + i - 1];
+         }
+         inner->count = leftCount;
+
+         return result;
+      }
+
+      Split insertIntoLeaf(Leaf *leaf, const Key &k)
+      {
+         int position = details::countLessEqual(leaf->keys, leaf->count, k);
+         for (int i = leaf->count; i > position; --i)
+            leaf->keys[i] = leaf->keys[i - 1];
+         leaf->keys[position] = k;
+
+         if (++leaf->count < Leaf::CAPACITY)
+            return Split();
+
+         auto right = details::createAligned<Leaf>();
+         const int leftCount = leaf->count / 2;
+         right->count = leaf->count - leftCount;
+         for (int i = 0; i < right->count; ++i)
+            right->keys[i] = leaf->keys[leftCount + i];
+         leaf->count = leftCount;
+
+         right->next = leaf->next;
+         right->prev = leaf;
+         if (leaf->next)
+            leaf->next->prev = right;
+         leaf->next = right;
+         if (mLastLeaf == leaf)
+            mLastLeaf = right;
+
+         Split result;
+         result.right = right;
+         result.key = right->keys[0];
+         result.rightSize = std::size_t(right->count);
+         return result;
+      }
+
+      void destroy(void *node, int level)
+      {
+         if (level == 0) {
+            details::destroyAligned(static_cast<Leaf *>(node));
+            return;
+         }
+
+         auto inner = static_cast<Inner *>(node);
+         for (int i = 0; i < inner->count; ++i)
+            destroy(inner->children[i], level - 1);
+         details::destroyAligned(inner);
+      }
+
+      void *mRoot;
+      Leaf *mLastLeaf;
+      int mHeight = 0;
+      std::size_t mSize = 0;
+   };
+
+   using IntBPlusTree = BPlusTree<int>;
+
+} // namespace Tree
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <random>
+#include <thread>
+
+namespace Tree {
+
+   /// Ordered set for many threads: lock-free skip list without removal. Every level is a sorted
+   /// linked list, a node is published by CAS on the lowest level first, so everything found on
+   /// the lowest level is in the set. Readers never write shared memory. Nodes are released with
+   /// the set, so no reclamation scheme is needed.
+   template <class Key>
+   class ConcurrentSet
+   {
+      static const int MAX_LEVEL = 24;
+
+      struct alignas(void *) SNode
+      {
+         SNode(const Key &k, int h) : mKey(k), mHeight(h)
+         {
+            for (int l = 0; l < h; ++l)
+               new (&next()[l]) std::atomic<SNode *>(nullptr);
+         }
+
+         // Links are placed right after the node in the same allocation
+         std::atomic<SNode *> *next() { return reinterpret_cast<std::atomic<SNode *> *>(this + 1); }
+
+         Key mKey;
+         int mHeight;
+      };
+
+      static_assert(alignof(SNode) >= alignof(std::atomic<SNode *>), "Links must be aligned.");
+
+   public:
+      ConcurrentSet() : mHead(create(Key(), MAX_LEVEL)) {}
+
+      ~ConcurrentSet()
+      {
+         SNode *node = mHead;
+         while (node) {
+            SNode *next = node->next()[0].load(std::memory_order_relaxed);
+            destroy(node);
+            node = next;
+         }
+      }
+
+      ConcurrentSet(const ConcurrentSet &) = delete;
+      ConcurrentSet &operator =(const ConcurrentSet &) = delete;
+
+      std::size_t size() const { return mSize.load(std::memory_order_relaxed); }
+
+      /// Returns false if the key is already in the set
+      bool insert(const Key &k)
+      {
+         SNode *preds[MAX_LEVEL];
+         SNode *succs[MAX_LEVEL];
+         const int height = randomHeight();
+
+         while (true) {
+            if (findImpl(k, preds, succs))
+               return false;
+
+            SNode *node = create(k, height);
+            for (int l = 0; l < height; ++l)
+               node->next()[l].store(succs[l], std::memory_order_relaxed);
+
+            // Linking on the lowest level is the moment when the key appears in the set
+            if (!preds[0]->next()[0].compare_exchange_strong(succs[0], node, std::memory_order_release,
+                                                             std::memory_order_relaxed)) {
+               destroy(node);
+               continue;
+            }
+
+            // Upper levels are only shortcuts, link them one by one, searching again on a race
+            for (int l = 1; l < height; ++l) {
+               while (!preds[l]->next()[l].compare_exchange_strong(succs[l], node, std::memory_order_release,
+                                                                   std::memory_order_relaxed)) {
+                  findImpl(k, preds, succs);
+                  node->next()[l].store(succs[l], std::memory_order_relaxed);
+               }
+            }
+
+            mSize.fetch_add(1, std::memory_order_relaxed);
+            return true;
+         }
+      }
+
+      bool contains(const Key &k) const
+      {
+         SNode *pred = mHead;
+         SNode *curr = nullptr;
+         for (int l = MAX_LEVEL - 1; l >= 0; --l) {
+            curr = pred->next()[l].load(std::memory_order_acquire);
+            while (curr && curr->mKey < k) {
+               pred = curr;
+               curr = curr->next()[l].load(std::memory_order_acquire);
+            }
+         }
+         return curr && !(k < curr->mKey);
+      }
+
+      /// In-order scan of keys in [lo, hi], sees all keys inserted before the call
+      template <class F>
+      void forEachInRange(const Key &lo, const Key &hi, F &&f) const
+      {
+         SNode *pred = mHead;
+         for (int l = MAX_LEVEL - 1; l >= 0; --l) {
+            SNode *curr = pred->next()[l].load(std::memory_order_acquire);
+            while (curr && curr->mKey < lo) {
+               pred = curr;
+               curr = curr->next()[l].load(std::memory_order_acquire);
+            }
+         }
+
+         for (SNode *n = pred->next()[0].load(std::memory_order_acquire); n && !(hi < n->mKey);
+              n = n->next()[0].load(std::memory_order_acquire))
+            f(n->mKey);
+      }
+
+      template <class F>
+      void forEach(F &&f) const
+      {
+         for (SNode *n = mHead->next()[0].load(std::memory_order_acquire); n;
+              n = n->next()[0].load(std::memory_order_acquire))
+            f(n->mKey);
+      }
+
+   private:
+      static SNode *create(const Key &k, int height)
+      {
+         void *p = ::operator new(sizeof(SNode) + height * sizeof(std::atomic<SNode *>));
+         return new (p) SNode(k, height);
+      }
+
+      static void destroy(SNode *node)
+      {
+         node->~SNode();
+         ::operator delete(node);
+      }
+
+      /// Geometric distribution with p = 1/2
+      static int randomHeight()
+      {
+         static thread_local std::minstd_rand generator(
+            unsigned(std::hash<std::thread::id>()(std::this_thread::get_id())));
+
+         int height = 1;
+         while (height < MAX_LEVEL && ((generator() >> 16) & 1))
+            ++height;
+         return height;
+      }
+
+      bool findImpl(const Key &k, SNode **preds, SNode **succs) const
+      {
+         SNode *pred = mHead;
+         for (int l = MAX_LEVEL - 1; l >= 0; --l) {
+            SNode *curr = pred->next()[l].load(std::memory_order_acquire);
+            while (curr && curr->mKey < k) {
+               pred = curr;
+               curr = curr->next()[l].load(std::memory_order_acquire);
+            }
+            preds[l] = pred;
+            succs[l] = curr;
+         }
+         return succs[0] && !(k < succs[0]->mKey);
+      }
+
+      SNode *mHead;
+      std::atomic<std::size_t> mSize {0};
+   };
+
+   using IntConcurrentSet = ConcurrentSet<int>;
+
+} // namespace Tree
@@ -1,5 +1,5 @@
 TEMPLATE = app
-CONFIG += console c++14
+CONFIG += console c++14 thread
 CONFIG -= app_bundle
 CONFIG -= qt
 
@@ -7,6 +7,14 @@ SOURCES += main.cpp
 
 HEADERS += \
     node.h \
-    graph.h
+    graph.h \
+    taskpool.h \
+    augmented.h \
+    bplustree.h \
+    concurrentset.h \
+    persistent.h \
+    sampling.h \
+    staticbst.h \
+    succinct.h
 
 QMAKE_CXX = g++-6
@@ -1,12 +1,29 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <list>
+#include <mutex>
 #include <numeric>
+#include <random>
+#include <thread>
 #include <unordered_map>
 
+#include <boost/multiprecision/cpp_int.hpp>
 #include <boost/optional.hpp>
 
 #include "node.h"
+#include "augmented.h"
+#include "bplustree.h"
+#include "concurrentset.h"
 #include "graph.h"
+#include "persistent.h"
+#include "sampling.h"
+#include "staticbst.h"
+#include "succinct.h"
+#include "taskpool.h"
 
 // Route between two nodes
 namespace rbn
@@ -57,22 +74,179 @@ namespace bst
 
     namespace details
     {
-        IntNodePtr createMinimalBSTImpl(std::vector<int> const& array, int from, int to)
+        // Nodes are created at their final depth, so attaching doesn't walk subtrees again
+        IntNodePtr createMinimalBSTImpl(std::vector<int> const& array, int from, int to, int depth)
         {
             if (to < from)
                 return nullptr;
 
             int mid = (from + to) / 2;
             auto node = std::make_shared<IntNode>(array.at(mid));
-            node->setLeftChild(createMinimalBSTImpl(array, from, mid - 1));
-            node->setRightChild(createMinimalBSTImpl(array, mid + 1, to));
+            node->mDepth = depth;
+            node->setLeftChild(createMinimalBSTImpl(array, from, mid - 1, depth + 1));
+            node->setRightChild(createMinimalBSTImpl(array, mid + 1, to, depth + 1));
             return node;
         }
     }
 
     IntNodePtr createMinimalBST(std::vector<int> const& array)
     {
-        return details::createMinimalBSTImpl(array, 0, array.size() - 1);
+        return details::createMinimalBSTImpl(array, 0, array.size() - 1, 0);
+    }
+
+    namespace details
+    {
+        /// Bump allocator for nodes of one bulk load. There is no deallocation of separate nodes,
+        /// all memory is released at once when the last node of the arena dies.
+        class Arena
+        {
+        public:
+            explicit Arena(std::size_t blockSize) : m_blockSize(std::max<std::size_t>(blockSize, 4096)) {}
+
+            void * allocate(std::size_t size, std::size_t alignment)
+            {
+                assert(alignment <= alignof(std::max_align_t));
+
+                std::size_t offset = (m_used + alignment - 1) & ~(alignment - 1);
+                if (m_blocks.empty() || offset + size > m_blockSize) {
+                    m_blockSize = std::max(m_blockSize, size);
+                    m_blocks.emplace_back(new char[m_blockSize]);
+                    offset = 0;
+                }
+
+                m_used = offset + size;
+                return m_blocks.back().get() + offset;
+            }
+
+        private:
+            std::size_t m_blockSize;
+            std::size_t m_used = 0;
+            std::vector<std::unique_ptr<char[]>> m_blocks;
+        };
+
+        template <class T>
+        struct ArenaAllocator
+        {
+            using value_type = T;
+
+            explicit ArenaAllocator(std::shared_ptr<Arena> a) : arena(std::move(a)) {}
+            template <class U> ArenaAllocator(ArenaAllocator<U> const& other) : arena(other.arena) {}
+
+            T * allocate(std::size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+            void deallocate(T *, std::size_t) {}
+
+            template <class U> bool operator ==(ArenaAllocator<U> const& other) const { return arena == other.arena; }
+            template <class U> bool operator !=(ArenaAllocator<U> const& other) const { return arena != other.arena; }
+
+            std::shared_ptr<Arena> arena;
+        };
+
+        using NodeAllocator = ArenaAllocator<IntNode>;
+
+        NodeAllocator makeAllocator(std::size_t nodesCount)
+        {
+            // Node and control block of shared pointer with the allocator inside it
+            const std::size_t nodeBytes = sizeof(IntNode) + 4 * sizeof(void *);
+            return NodeAllocator(std::make_shared<Arena>(nodesCount * nodeBytes));
+        }
+
+        // Root of the range [from, to). It's the true middle even for runs of equal keys, so they
+        // may be on both sides of the root and many duplicates don't make a chain
+        std::size_t middle(std::size_t from, std::size_t to)
+        {
+            return (from + to - 1) / 2;
+        }
+
+        IntNodePtr makeNode(int key, std::size_t size, int depth, NodeAllocator const& allocator)
+        {
+            auto node = std::allocate_shared<IntNode>(allocator, key);
+            node->mSize = int(size);
+            node->mDepth = depth;
+            return node;
+        }
+
+        // Range is [from, to), shape of the tree is the same as for createMinimalBST
+        IntNodePtr bulkLoadSequential(int const* keys, std::size_t from, std::size_t to, int depth,
+                                      NodeAllocator const& allocator)
+        {
+            if (from == to)
+                return nullptr;
+
+            std::size_t mid = middle(from, to);
+            auto node = makeNode(keys[mid], to - from, depth, allocator);
+            node->setLeftChild(bulkLoadSequential(keys, from, mid, depth + 1, allocator));
+            node->setRightChild(bulkLoadSequential(keys, mid + 1, to, depth + 1, allocator));
+            return node;
+        }
+
+        IntNodePtr bulkLoadImpl(int const* keys, std::size_t from, std::size_t to, int depth,
+                                NodeAllocator const& allocator, tp::TaskPool & pool, int cutoffDepth)
+        {
+            if (cutoffDepth <= 0 || from == to)
+                return bulkLoadSequential(keys, from, to, depth, allocator);
+
+            std::size_t mid = middle(from, to);
+            auto node = makeNode(keys[mid], to - from, depth, allocator);
+
+            // Spawned task gets own arena sized for the nodes it's going to create by itself
+            auto leftAllocator = makeAllocator(((mid - from) >> (cutoffDepth - 1)) + cutoffDepth);
+            auto leftTask = pool.spawn([=, &pool] {
+                return bulkLoadImpl(keys, from, mid, depth + 1, leftAllocator, pool, cutoffDepth - 1);
+            });
+            node->setRightChild(bulkLoadImpl(keys, mid + 1, to, depth + 1, allocator, pool, cutoffDepth - 1));
+            node->setLeftChild(pool.wait(leftTask));
+
+            return node;
+        }
+
+        void collectKeys(IntNode const* node, std::vector<int> & keys)
+        {
+            if (!node)
+                return;
+
+            collectKeys(node->mLeftChild.get(), keys);
+            keys.push_back(node->mKey);
+            collectKeys(node->mRightChild.get(), keys);
+        }
+
+        std::vector<int> mergedKeys(IntNodePtr const& t1, IntNodePtr const& t2)
+        {
+            std::vector<int> keys1, keys2;
+            collectKeys(t1.get(), keys1);
+            collectKeys(t2.get(), keys2);
+
+            std::vector<int> result(keys1.size() + keys2.size());
+            std::merge(keys1.begin(), keys1.end(), keys2.begin(), keys2.end(), result.begin());
+            return result;
+        }
+    }
+
+    /// Parallel version of createMinimalBST. Nodes are allocated from arenas, one per task,
+    /// and sizes of subtrees are filled in
+    IntNodePtr bulkLoad(std::vector<int> const& sorted, tp::TaskPool & pool,
+                        int cutoffDepth = tp::DEFAULT_CUTOFF_DEPTH)
+    {
+        auto allocator = details::makeAllocator((sorted.size() >> cutoffDepth) + cutoffDepth + 1);
+        return details::bulkLoadImpl(sorted.data(), 0, sorted.size(), 0, allocator, pool, cutoffDepth);
+    }
+
+    /// Sequential version of the above, all nodes are in one arena
+    IntNodePtr bulkLoad(std::vector<int> const& sorted)
+    {
+        auto allocator = details::makeAllocator(sorted.size());
+        return details::bulkLoadSequential(sorted.data(), 0, sorted.size(), 0, allocator);
+    }
+
+    /// Flattens both BSTs, merges them and rebuilds balanced tree. O(n + m)
+    IntNodePtr merge(IntNodePtr const& t1, IntNodePtr const& t2)
+    {
+        return bulkLoad(details::mergedKeys(t1, t2));
+    }
+
+    IntNodePtr merge(IntNodePtr const& t1, IntNodePtr const& t2, tp::TaskPool & pool,
+                     int cutoffDepth = tp::DEFAULT_CUTOFF_DEPTH)
+    {
+        return bulkLoad(details::mergedKeys(t1, t2), pool, cutoffDepth);
     }
 }
 
@@ -101,6 +275,33 @@ namespace lod
             createLevelLinkedListImpl(root->mLeftChild, lists, level + 1);
             createLevelLinkedListImpl(root->mRightChild, lists, level + 1);
         }
+
+        // Every task collects lists for own subtree, lists of the subtrees are spliced level by level
+        NodesListsArray createLevelLinkedListParallel(IntNodePtr const& root, tp::TaskPool & pool,
+                                                      int cutoffDepth)
+        {
+            NodesListsArray lists;
+            if (!root || cutoffDepth <= 0) {
+                createLevelLinkedListImpl(root, lists, 0);
+                return lists;
+            }
+
+            auto left = root->mLeftChild;
+            auto leftTask = pool.spawn([left, &pool, cutoffDepth] {
+                return createLevelLinkedListParallel(left, pool, cutoffDepth - 1);
+            });
+            auto rightLists = createLevelLinkedListParallel(root->mRightChild, pool, cutoffDepth - 1);
+            auto leftLists  = pool.wait(leftTask);
+
+            lists.resize(std::max(leftLists.size(), rightLists.size()) + 1);
+            lists.front().push_back(root);
+            for (std::size_t level = 0; level < leftLists.size(); ++level)
+                lists[level + 1].splice(lists[level + 1].end(), leftLists[level]);
+            for (std::size_t level = 0; level < rightLists.size(); ++level)
+                lists[level + 1].splice(lists[level + 1].end(), rightLists[level]);
+
+            return lists;
+        }
     }
 
     NodesListsArray createLevelLinkedList(IntNodePtr const& root)
@@ -109,6 +310,108 @@ namespace lod
         details::createLevelLinkedListImpl(root, lists, 0);
         return lists;
     }
+
+    NodesListsArray createLevelLinkedList(IntNodePtr const& root, tp::TaskPool & pool,
+                                          int cutoffDepth = tp::DEFAULT_CUTOFF_DEPTH)
+    {
+        return details::createLevelLinkedListParallel(root, pool, cutoffDepth);
+    }
+
+    // Breadth-first variant without a list node and a reference counter increment per tree node.
+    // All levels are stored in one buffer, level i is [offsets[i], offsets[i + 1])
+    struct LevelOrder
+    {
+        using Nodes = std::vector<IntNode const*>;
+        using Range = std::pair<Nodes::const_iterator, Nodes::const_iterator>;
+
+        std::size_t levelsCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+        Range level(std::size_t index) const
+        {
+            if (index >= levelsCount())
+                throw std::out_of_range("There is no such level.");
+
+            return {nodes.begin() + offsets[index], nodes.begin() + offsets[index + 1]};
+        }
+
+        Nodes nodes;
+        std::vector<std::size_t> offsets;
+    };
+
+    LevelOrder createLevelOrder(IntNodePtr const& root)
+    {
+        LevelOrder result;
+        if (!root)
+            return result;
+
+        // The buffer itself is the queue of BFS
+        result.nodes.push_back(root.get());
+        result.offsets.push_back(0);
+        for (std::size_t levelBegin = 0; levelBegin < result.nodes.size(); ) {
+            const std::size_t levelEnd = result.nodes.size();
+            for (std::size_t i = levelBegin; i < levelEnd; ++i) {
+                IntNode const* node = result.nodes[i];
+                if (node->mLeftChild)
+                    result.nodes.push_back(node->mLeftChild.get());
+                if (node->mRightChild)
+                    result.nodes.push_back(node->mRightChild.get());
+            }
+
+            result.offsets.push_back(levelEnd);
+            levelBegin = levelEnd;
+        }
+
+        return result;
+    }
+
+    /// Streams the tree level by level, only the current level is kept in memory
+    class LevelIterator
+    {
+    public: // Types
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = std::vector<IntNode const*>;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = value_type const*;
+        using reference         = value_type const&;
+
+    public: // Methods
+        LevelIterator() {}
+        explicit LevelIterator(IntNodePtr const& root) { if (root) m_level.push_back(root.get()); }
+
+        reference operator *() const { return m_level; }
+        pointer operator ->() const { return &m_level; }
+
+        LevelIterator & operator ++()
+        {
+            m_next.clear();
+            for (auto && node : m_level) {
+                if (node->mLeftChild)
+                    m_next.push_back(node->mLeftChild.get());
+                if (node->mRightChild)
+                    m_next.push_back(node->mRightChild.get());
+            }
+
+            m_level.swap(m_next);
+            return *this;
+        }
+
+        bool operator ==(LevelIterator const& other) const { return m_level == other.m_level; }
+        bool operator !=(LevelIterator const& other) const { return !(*this == other); }
+
+    private: // Data
+        value_type m_level;
+        value_type m_next;
+    };
+
+    struct Levels
+    {
+        LevelIterator begin() const { return LevelIterator(root); }
+        LevelIterator end() const { return LevelIterator(); }
+
+        IntNodePtr root;
+    };
+
+    Levels levels(IntNodePtr const& root) { return Levels{root}; }
 }
 
 // Check if tree is balanced (difference between subtrees no more than one)
@@ -138,12 +441,39 @@ namespace bt
             else
                 return std::max(leftHeight, rightHeight) + 1;
         }
+
+        int checkHeightParallel(IntNodePtr const& root, tp::TaskPool & pool, int cutoffDepth)
+        {
+            if (!root || cutoffDepth <= 0)
+                return checkHeight(root);
+
+            auto left = root->mLeftChild;
+            auto leftTask = pool.spawn([left, &pool, cutoffDepth] {
+                return checkHeightParallel(left, pool, cutoffDepth - 1);
+            });
+            int rightHeight = checkHeightParallel(root->mRightChild, pool, cutoffDepth - 1);
+            int leftHeight  = pool.wait(leftTask);
+
+            if (leftHeight == ERROR_TAG || rightHeight == ERROR_TAG)
+                return ERROR_TAG; // Propagate error to the top
+
+            if (std::abs(leftHeight - rightHeight) > 1)
+                return ERROR_TAG; // Pass error back
+            else
+                return std::max(leftHeight, rightHeight) + 1;
+        }
     }
 
     bool isBalanced(IntNodePtr const& root)
     {
         return details::checkHeight(root) != details::ERROR_TAG;
     }
+
+    bool isBalanced(IntNodePtr const& root, tp::TaskPool & pool,
+                    int cutoffDepth = tp::DEFAULT_CUTOFF_DEPTH)
+    {
+        return details::checkHeightParallel(root, pool, cutoffDepth) != details::ERROR_TAG;
+    }
 }
 
 // Check if tree is a valid BST
@@ -154,12 +484,15 @@ namespace vbst
     namespace details
     {
         using Int = boost::optional<int>;
+
+        // Equal keys may be on both sides of a node: createMinimalBST and bulkLoad split runs of
+        // duplicates in the middle, find stops at the first equal key anyway
         bool checkBSTImpl(IntNodePtr const& n, Int min = Int(), Int max = Int())
         {
             if (!n)
                 return true;
 
-            if ((min && n->mKey <= min) || (max && n->mKey > max))
+            if ((min && n->mKey < min) || (max && n->mKey > max))
                 return false;
 
             if (!checkBSTImpl(n->mLeftChild, min, n->mKey) ||
@@ -168,12 +501,38 @@ namespace vbst
 
             return true;
         }
+
+        bool checkBSTParallel(IntNodePtr const& n, tp::TaskPool & pool, int cutoffDepth,
+                              Int min = Int(), Int max = Int())
+        {
+            if (!n || cutoffDepth <= 0)
+                return checkBSTImpl(n, min, max);
+
+            if ((min && n->mKey < min) || (max && n->mKey > max))
+                return false;
+
+            auto left = n->mLeftChild;
+            Int key = n->mKey;
+            auto leftTask = pool.spawn([left, &pool, cutoffDepth, min, key] {
+                return checkBSTParallel(left, pool, cutoffDepth - 1, min, key);
+            });
+            bool rightValid = checkBSTParallel(n->mRightChild, pool, cutoffDepth - 1, n->mKey, max);
+
+            // Always wait, the task must not outlive the pool user
+            return pool.wait(leftTask) && rightValid;
+        }
     }
 
     bool checkBST(IntNodePtr const& root)
     {
         return details::checkBSTImpl(root);
     }
+
+    bool checkBST(IntNodePtr const& root, tp::TaskPool & pool,
+                  int cutoffDepth = tp::DEFAULT_CUTOFF_DEPTH)
+    {
+        return details::checkBSTParallel(root, pool, cutoffDepth);
+    }
 }
 
 // Successor (find "next" node)
@@ -216,6 +575,176 @@ namespace sr
             return parent;
         }
     }
+
+    /// Bidirectional in-order iterator. Keeps the path from the root to the current node as raw
+    /// pointers, so steps neither lock parent links nor touch reference counters.
+    class InOrderIterator
+    {
+    public: // Types
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type        = IntNode;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = IntNode *;
+        using reference         = IntNode &;
+        using Path              = std::vector<IntNode *>;
+
+    public: // Methods
+        InOrderIterator() {}
+        /// Empty path is the end
+        InOrderIterator(IntNode * root, Path path) : m_root(root), m_path(std::move(path)) {}
+
+        reference operator *() const { return *m_path.back(); }
+        pointer operator ->() const { return m_path.back(); }
+
+        InOrderIterator & operator ++()
+        {
+            IntNode * node = m_path.back();
+            if (node->mRightChild) {
+                pushLeftmost(node->mRightChild.get());
+            } else {
+                // Go up until we're on left node instead of right
+                IntNode * child = nullptr;
+                do {
+                    child = m_path.back();
+                    m_path.pop_back();
+                } while (!m_path.empty() && m_path.back()->mRightChild.get() == child);
+            }
+
+            return *this;
+        }
+
+        InOrderIterator & operator --()
+        {
+            if (m_path.empty()) {
+                pushRightmost(m_root);
+                return *this;
+            }
+
+            IntNode * node = m_path.back();
+            if (node->mLeftChild) {
+                pushRightmost(node->mLeftChild.get());
+            } else {
+                IntNode * child = nullptr;
+                do {
+                    child = m_path.back();
+                    m_path.pop_back();
+                } while (!m_path.empty() && m_path.back()->mLeftChild.get() == child);
+            }
+
+            return *this;
+        }
+
+        InOrderIterator operator ++(int) { auto tmp = *this; ++*this; return tmp; }
+        InOrderIterator operator --(int) { auto tmp = *this; --*this; return tmp; }
+
+        bool operator ==(InOrderIterator const& other) const
+        {
+            return m_path.empty() || other.m_path.empty() ? m_path.empty() == other.m_path.empty()
+                                                          : m_path.back() == other.m_path.back();
+        }
+        bool operator !=(InOrderIterator const& other) const { return !(*this == other); }
+
+    private: // Methods
+        void pushLeftmost(IntNode * node)
+        {
+            for (; node; node = node->mLeftChild.get())
+                m_path.push_back(node);
+        }
+
+        void pushRightmost(IntNode * node)
+        {
+            for (; node; node = node->mRightChild.get())
+                m_path.push_back(node);
+        }
+
+    private: // Data
+        IntNode * m_root = nullptr;
+        Path m_path;
+    };
+
+    namespace details
+    {
+        // Descends to the first node for which goLeft is true, path is cut after it
+        template <class GoLeft>
+        InOrderIterator bound(IntNodePtr const& root, GoLeft && goLeft)
+        {
+            InOrderIterator::Path path;
+            std::size_t found = 0;
+
+            for (IntNode * node = root.get(); node; ) {
+                path.push_back(node);
+                if (goLeft(node->mKey)) {
+                    found = path.size();
+                    node = node->mLeftChild.get();
+                } else
+                    node = node->mRightChild.get();
+            }
+
+            path.resize(found);
+            return InOrderIterator(root.get(), std::move(path));
+        }
+
+        template <class F>
+        void forEachInRangeImpl(IntNode * node, int lo, int hi, F & f)
+        {
+            if (!node)
+                return;
+
+            // Equal keys are inserted to the left
+            if (lo <= node->mKey)
+                forEachInRangeImpl(node->mLeftChild.get(), lo, hi, f);
+
+            if (lo <= node->mKey && node->mKey <= hi)
+                f(*node);
+
+            if (node->mKey < hi)
+                forEachInRangeImpl(node->mRightChild.get(), lo, hi, f);
+        }
+    }
+
+    InOrderIterator begin(IntNodePtr const& root)
+    {
+        return details::bound(root, [](int) { return true; });
+    }
+
+    InOrderIterator end(IntNodePtr const& root)
+    {
+        return InOrderIterator(root.get(), {});
+    }
+
+    /// First node with key not less than given one
+    InOrderIterator lowerBound(IntNodePtr const& root, int key)
+    {
+        return details::bound(root, [key](int k) { return k >= key; });
+    }
+
+    /// First node with key greater than given one
+    InOrderIterator upperBound(IntNodePtr const& root, int key)
+    {
+        return details::bound(root, [key](int k) { return k > key; });
+    }
+
+    struct Range
+    {
+        InOrderIterator begin() const { return first; }
+        InOrderIterator end() const { return last; }
+
+        InOrderIterator first;
+        InOrderIterator last;
+    };
+
+    /// Nodes with keys in [lo, hi]
+    Range range(IntNodePtr const& root, int lo, int hi)
+    {
+        return lo > hi ? Range{end(root), end(root)} : Range{lowerBound(root, lo), upperBound(root, hi)};
+    }
+
+    /// Calls f for nodes with keys in [lo, hi] in order, O(log n + k) for balanced tree
+    template <class F>
+    void forEachInRange(IntNodePtr const& root, int lo, int hi, F && f)
+    {
+        details::forEachInRangeImpl(root.get(), lo, hi, f);
+    }
 }
 
 // Topological sort.
@@ -321,6 +850,114 @@ namespace fca
 
         return !shallower || !deeper ? nullptr : shallower;
     }
+
+    /// Index for a lot of queries on the same tree: Euler tour of the tree plus sparse table of
+    /// minimums by depth. O(n log n) to build, O(1) per query without touching parent links.
+    class AncestorIndex
+    {
+    public: // Types
+        using Query = std::pair<IntNodePtr, IntNodePtr>;
+        using Queries = std::vector<Query>;
+
+    public: // Methods
+        explicit AncestorIndex(IntNodePtr const& root)
+        {
+            if (!root)
+                return;
+
+            tour(root.get(), 0);
+            buildTable();
+        }
+
+        /// Returns nullptr if one of nodes is not in the indexed tree
+        IntNode * commonAncestor(IntNode const* f, IntNode const* s) const
+        {
+            auto fIt = m_first.find(f);
+            auto sIt = m_first.find(s);
+            if (fIt == m_first.end() || sIt == m_first.end())
+                return nullptr;
+
+            std::size_t from = std::min(fIt->second, sIt->second);
+            std::size_t to   = std::max(fIt->second, sIt->second);
+
+            // Two overlapping power of two ranges cover [from, to]
+            std::size_t level = m_log[to - from + 1];
+            std::size_t l = m_table[level][from];
+            std::size_t r = m_table[level][to - (std::size_t(1) << level) + 1];
+
+            return m_tour[m_depths[l] <= m_depths[r] ? l : r];
+        }
+
+        IntNodePtr commonAncestor(IntNodePtr const& f, IntNodePtr const& s) const
+        {
+            assert(f && s);
+            IntNode * ancestor = commonAncestor(f.get(), s.get());
+            return ancestor ? ancestor->ptr() : nullptr;
+        }
+
+        std::vector<IntNode *> commonAncestors(Queries const& queries) const
+        {
+            std::vector<IntNode *> result(queries.size());
+            std::transform(queries.begin(), queries.end(), result.begin(),
+                           [this](auto && q) { return commonAncestor(q.first.get(), q.second.get()); });
+            return result;
+        }
+
+    private: // Methods
+        void tour(IntNode * node, int depth)
+        {
+            m_first.emplace(node, m_tour.size());
+            visit(node, depth);
+
+            for (auto && child : {node->mLeftChild.get(), node->mRightChild.get()}) {
+                if (child) {
+                    tour(child, depth + 1);
+                    visit(node, depth);
+                }
+            }
+        }
+
+        void visit(IntNode * node, int depth)
+        {
+            m_tour.push_back(node);
+            m_depths.push_back(depth);
+        }
+
+        void buildTable()
+        {
+            const std::size_t size = m_tour.size();
+
+            m_log.assign(size + 1, 0);
+            for (std::size_t i = 2; i <= size; ++i)
+                m_log[i] = m_log[i / 2] + 1;
+
+            // Level k keeps position of the shallowest node in [i, i + 2^k)
+            m_table.resize(m_log[size] + 1);
+            m_table[0].resize(size);
+            std::iota(m_table[0].begin(), m_table[0].end(), 0);
+
+            for (std::size_t k = 1; k < m_table.size(); ++k) {
+                const std::size_t half = std::size_t(1) << (k - 1);
+                auto && prev = m_table[k - 1];
+                auto && level = m_table[k];
+
+                level.resize(size - 2 * half + 1);
+                for (std::size_t i = 0; i < level.size(); ++i) {
+                    std::size_t l = prev[i];
+                    std::size_t r = prev[i + half];
+                    level[i] = m_depths[l] <= m_depths[r] ? l : r;
+                }
+            }
+        }
+
+    private: // Data
+        std::vector<IntNode *> m_tour;
+        std::vector<int> m_depths;
+        std::unordered_map<IntNode const*, std::size_t> m_first;
+
+        std::vector<std::size_t> m_log;
+        std::vector<std::vector<std::size_t>> m_table;
+    };
 }
 
 // Given a BST which created by traversing array left to right,
@@ -396,6 +1033,148 @@ namespace bstsq
 
         return result;
     }
+
+    namespace details
+    {
+        std::size_t subtreeSize(IntNode const* node)
+        {
+            return node ? 1 + subtreeSize(node->mLeftChild.get()) + subtreeSize(node->mRightChild.get())
+                        : 0;
+        }
+    }
+
+    /// Lazy version of allSequences. Every sequence is a topological order of the tree (parent goes
+    /// before children), so the state is the frontier of nodes which can be inserted next, plus the
+    /// choice made for every position of the sequence. O(n) memory regardless of the result size.
+    class SequenceGenerator
+    {
+    public: // Methods
+        explicit SequenceGenerator(IntNodePtr const& root)
+            : m_size(details::subtreeSize(root.get()))
+        {
+            if (root)
+                m_frontier.push_back(root.get());
+
+            m_choices.reserve(m_size);
+            m_picked.reserve(m_size);
+        }
+
+        std::size_t sequenceSize() const { return m_size; }
+
+        /// Writes the next sequence into the buffer of sequenceSize() elements.
+        /// Returns false if all sequences are produced.
+        bool next(int * buffer)
+        {
+            if (m_finished)
+                return false;
+
+            if (!m_started)
+                m_started = true;
+            else if (!advance()) {
+                m_finished = true;
+                return false;
+            }
+
+            while (m_picked.size() < m_size)
+                pick(0);
+
+            for (std::size_t i = 0; i < m_size; ++i)
+                buffer[i] = m_picked[i]->mKey;
+
+            return true;
+        }
+
+        bool next(std::vector<int> & sequence)
+        {
+            sequence.resize(m_size);
+            return next(sequence.data());
+        }
+
+    private: // Methods
+        /// Replaces the deepest choice which has alternatives with the next one
+        bool advance()
+        {
+            while (!m_picked.empty()) {
+                std::size_t choice = m_choices.back();
+                undo();
+
+                if (choice + 1 < m_frontier.size()) {
+                    pick(choice + 1);
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void pick(std::size_t index)
+        {
+            IntNode const* node = m_frontier[index];
+            std::swap(m_frontier[index], m_frontier.back());
+            m_frontier.pop_back();
+
+            if (node->mLeftChild)
+                m_frontier.push_back(node->mLeftChild.get());
+            if (node->mRightChild)
+                m_frontier.push_back(node->mRightChild.get());
+
+            m_choices.push_back(index);
+            m_picked.push_back(node);
+        }
+
+        /// Exact reverse of pick, so the order of the frontier is restored as well
+        void undo()
+        {
+            IntNode const* node = m_picked.back();
+            std::size_t index = m_choices.back();
+            m_picked.pop_back();
+            m_choices.pop_back();
+
+            m_frontier.resize(m_frontier.size() - !!node->mLeftChild - !!node->mRightChild);
+            m_frontier.push_back(node);
+            std::swap(m_frontier[index], m_frontier.back());
+        }
+
+    private: // Data
+        std::size_t m_size;
+        bool m_started  = false;
+        bool m_finished = false;
+
+        std::vector<IntNode const*> m_frontier;
+        std::vector<std::size_t>    m_choices;
+        std::vector<IntNode const*> m_picked;
+    };
+
+    using BigInt = boost::multiprecision::cpp_int;
+
+    namespace details
+    {
+        // Returns the size of the subtree and accumulates the product of all subtrees sizes
+        std::size_t sizesProduct(IntNode const* node, BigInt & product)
+        {
+            if (!node)
+                return 0;
+
+            std::size_t size = 1 + sizesProduct(node->mLeftChild.get(), product)
+                                 + sizesProduct(node->mRightChild.get(), product);
+            product *= size;
+            return size;
+        }
+    }
+
+    /// Number of sequences without producing them. It's a product of the weaves counts
+    /// C(left + right, left) over all nodes, which collapses to n! / (product of subtrees sizes)
+    BigInt countSequences(IntNodePtr const& root)
+    {
+        BigInt sizes = 1;
+        std::size_t n = details::sizesProduct(root.get(), sizes);
+
+        BigInt factorial = 1;
+        for (std::size_t i = 2; i <= n; ++i)
+            factorial *= i;
+
+        return factorial / sizes;
+    }
 }
 
 // There are two large binary trees (T1 and T2), check if T2 is sutree of T1. T1 is bigger.
@@ -452,7 +1231,7 @@ namespace sp
             if (newCount == 0)
                 pathCount.erase(key); // Reduce space
             else
-                pathCount[key] = delta;
+                pathCount[key] = newCount;
         }
 
         int countPathsWithSumImpl(IntNodePtr const& node, int targetSum, int runnigSum,
@@ -478,6 +1257,34 @@ namespace sp
 
             return totalPaths;
         }
+
+        // Spawned task gets own copy of prefix sums, seeded with running sums of the ancestors
+        int countPathsWithSumParallel(IntNodePtr const& node, int targetSum, int runnigSum,
+                                      PathCount & pathCount, tp::TaskPool & pool, int cutoffDepth)
+        {
+            if (!node || cutoffDepth <= 0)
+                return countPathsWithSumImpl(node, targetSum, runnigSum, pathCount);
+
+            runnigSum += node->mKey;
+            int totalPaths = pathCount[runnigSum - targetSum];
+            if (runnigSum == targetSum)
+                ++totalPaths;
+
+            incVal(pathCount, runnigSum, 1);
+
+            auto left = node->mLeftChild;
+            auto leftTask = pool.spawn([left, targetSum, runnigSum, pathCount, &pool, cutoffDepth]() mutable {
+                return countPathsWithSumParallel(left, targetSum, runnigSum, pathCount, pool,
+                                                 cutoffDepth - 1);
+            });
+            totalPaths += countPathsWithSumParallel(node->mRightChild, targetSum, runnigSum,
+                                                    pathCount, pool, cutoffDepth - 1);
+            totalPaths += pool.wait(leftTask);
+
+            incVal(pathCount, runnigSum, -1);
+
+            return totalPaths;
+        }
     }
 
     int countPathWithSum(IntNodePtr const& node, int sum)
@@ -485,6 +1292,150 @@ namespace sp
         details::PathCount pathCount;
         return details::countPathsWithSumImpl(node, sum, 0, pathCount);
     }
+
+    int countPathWithSum(IntNodePtr const& node, int sum, tp::TaskPool & pool,
+                         int cutoffDepth = tp::DEFAULT_CUTOFF_DEPTH)
+    {
+        details::PathCount pathCount;
+        return details::countPathsWithSumParallel(node, sum, 0, pathCount, pool, cutoffDepth);
+    }
+
+    namespace details
+    {
+        /// Counter of prefix sums with open addressing and linear probing. Removed entries are
+        /// replaced by backward shift, so the table never has more entries than the current path.
+        class PrefixSums
+        {
+        public:
+            PrefixSums() : m_slots(64) {}
+
+            std::size_t count(long long sum) const
+            {
+                for (std::size_t i = home(sum); m_slots[i].count != 0; i = next(i))
+                    if (m_slots[i].sum == sum)
+                        return m_slots[i].count;
+
+                return 0;
+            }
+
+            void increment(long long sum)
+            {
+                std::size_t i = home(sum);
+                for (; m_slots[i].count != 0; i = next(i)) {
+                    if (m_slots[i].sum == sum) {
+                        ++m_slots[i].count;
+                        return;
+                    }
+                }
+
+                m_slots[i] = {sum, 1};
+                if (++m_used * 2 > m_slots.size())
+                    grow();
+            }
+
+            void decrement(long long sum)
+            {
+                std::size_t i = home(sum);
+                while (m_slots[i].sum != sum)
+                    i = next(i);
+
+                if (--m_slots[i].count == 0) {
+                    --m_used;
+                    shiftBack(i);
+                }
+            }
+
+        private:
+            struct Slot
+            {
+                long long sum;
+                std::size_t count; // Zero is the empty slot
+            };
+
+            std::size_t home(long long sum) const
+            {
+                // Fibonacci hashing, the highest bits are the best mixed
+                return std::size_t((std::uint64_t(sum) * 0x9E3779B97F4A7C15ull) >> m_shift);
+            }
+
+            std::size_t next(std::size_t i) const { return (i + 1) & (m_slots.size() - 1); }
+
+            // Moves following entries of the cluster into the hole unless it puts them before home
+            void shiftBack(std::size_t hole)
+            {
+                for (std::size_t i = next(hole); m_slots[i].count != 0; i = next(i)) {
+                    std::size_t h = home(m_slots[i].sum);
+                    bool between = hole <= i ? hole < h && h <= i : hole < h || h <= i;
+                    if (!between) {
+                        m_slots[hole] = m_slots[i];
+                        m_slots[i].count = 0;
+                        hole = i;
+                    }
+                }
+            }
+
+            void grow()
+            {
+                std::vector<Slot> old(m_slots.size() * 2);
+                old.swap(m_slots);
+                --m_shift;
+
+                for (auto && slot : old) {
+                    if (slot.count != 0) {
+                        std::size_t i = home(slot.sum);
+                        while (m_slots[i].count != 0)
+                            i = next(i);
+                        m_slots[i] = slot;
+                    }
+                }
+            }
+
+            std::vector<Slot> m_slots;
+            std::size_t m_used = 0;
+            int m_shift = 64 - 6;
+        };
+    }
+
+    /// Counts for all target sums in one traversal. Explicit stack, so deep trees are fine
+    std::vector<std::size_t> countPathsWithSums(IntNodePtr const& root, std::vector<int> const& targets)
+    {
+        struct Frame
+        {
+            IntNode const* node;
+            long long sum; // Before the node when entering, including it when leaving
+            bool leaving;
+        };
+
+        std::vector<std::size_t> counts(targets.size(), 0);
+        details::PrefixSums prefixSums;
+
+        std::vector<Frame> stack;
+        if (root)
+            stack.push_back({root.get(), 0, false});
+
+        while (!stack.empty()) {
+            Frame frame = stack.back();
+            stack.pop_back();
+
+            if (frame.leaving) {
+                prefixSums.decrement(frame.sum);
+                continue;
+            }
+
+            long long runningSum = frame.sum + frame.node->mKey;
+            for (std::size_t i = 0; i < targets.size(); ++i)
+                counts[i] += prefixSums.count(runningSum - targets[i]) + (runningSum == targets[i]);
+
+            prefixSums.increment(runningSum);
+            stack.push_back({frame.node, runningSum, true});
+            if (frame.node->mRightChild)
+                stack.push_back({frame.node->mRightChild.get(), runningSum, false});
+            if (frame.node->mLeftChild)
+                stack.push_back({frame.node->mLeftChild.get(), runningSum, false});
+        }
+
+        return counts;
+    }
 }
 
 int main(int /*argc*/, char */*argv*/[])
@@ -696,11 +1647,461 @@ int main(int /*argc*/, char */*argv*/[])
 //    }
 
     // 12 // TODO: revise
+//    try {
+//        std::vector<int> v {1, 2, 3, 4, 5};
+//        auto tree = bst::createMinimalBST(v);
+
+//        std::cout << sp::countPathWithSum(tree, 3) << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 13
+    // Fork-join versions of the whole-tree passes
+//    try {
+//        std::vector<int> v(1 << 20);
+//        std::iota(v.begin(), v.end(), -(1 << 19));
+//        auto tree = bst::createMinimalBST(v);
+
+//        tp::TaskPool pool;
+
+//        auto measure = [](auto && f) {
+//            auto start = std::chrono::steady_clock::now();
+//            auto result = f();
+//            auto stop = std::chrono::steady_clock::now();
+//            std::cout << result << "\t"
+//                      << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count()
+//                      << " ms" << std::endl;
+//        };
+
+//        std::cout << std::boolalpha;
+//        measure([&] { return bt::isBalanced(tree); });
+//        measure([&] { return bt::isBalanced(tree, pool); });
+//        measure([&] { return vbst::checkBST(tree); });
+//        measure([&] { return vbst::checkBST(tree, pool); });
+//        measure([&] { return sp::countPathWithSum(tree, 42); });
+//        measure([&] { return sp::countPathWithSum(tree, 42, pool); });
+//        measure([&] { return lod::createLevelLinkedList(tree).back().size(); });
+//        measure([&] { return lod::createLevelLinkedList(tree, pool).back().size(); });
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 14
+//    try {
+//        std::vector<int> v {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+//        auto tree = bst::createMinimalBST(v);
+
+//        auto order = lod::createLevelOrder(tree);
+//        for (std::size_t level = 0; level < order.levelsCount(); ++level) {
+//            auto range = order.level(level);
+//            for (auto it = range.first; it != range.second; ++it)
+//                std::cout << (*it)->mKey << "\t";
+//            std::cout << std::endl;
+//        }
+
+//        for (auto && level : lod::levels(tree)) {
+//            for (auto && n : level)
+//                std::cout << n->mKey << "\t";
+//            std::cout << std::endl;
+//        }
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 15
+//    try {
+//        std::vector<int> v {1, 2, 3, 4, 5};
+//        auto tree = bst::createMinimalBST(v);
+
+//        bstsq::SequenceGenerator generator(tree);
+//        std::vector<int> sequence;
+//        while (generator.next(sequence)) {
+//            for (auto && e : sequence)
+//                std::cout << e << "\t";
+//            std::cout << std::endl;
+//        }
+
+//        std::cout << "Count: " << bstsq::countSequences(tree) << std::endl;
+
+//        std::vector<int> big(127);
+//        std::iota(big.begin(), big.end(), 0);
+//        std::cout << "Count for 127 nodes: " << bstsq::countSequences(bst::createMinimalBST(big))
+//                  << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 16
+//    try {
+//        std::vector<int> v {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+//        auto tree = bst::createMinimalBST(v);
+
+//        Tree::IntNodePtr min = tree->mLeftChild;
+//        while (min->mLeftChild)
+//            min = min->mLeftChild;
+
+//        Tree::IntNodePtr someNode = min->parent()->parent()->mRightChild->mRightChild;
+//        min = min->makeRightChild(200)->makeLeftChild(300);
+
+//        fca::AncestorIndex index(tree);
+//        std::cout << "First common ancestor: " << fca::commonAncestor(min, someNode)->mKey << "\t"
+//                  << index.commonAncestor(min, someNode)->mKey << std::endl;
+
+//        auto ancestors = index.commonAncestors({{min, someNode}, {min, tree}, {someNode, someNode}});
+//        for (auto && a : ancestors)
+//            std::cout << a->mKey << "\t";
+//        std::cout << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 17
+//    try {
+//        std::vector<int> v {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+//        auto tree = bst::createMinimalBST(v);
+
+//        for (auto it = sr::begin(tree); it != sr::end(tree); ++it)
+//            std::cout << it->mKey << "\t";
+//        std::cout << std::endl;
+
+//        for (auto it = sr::end(tree); it != sr::begin(tree); )
+//            std::cout << (--it)->mKey << "\t";
+//        std::cout << std::endl;
+
+//        for (auto && n : sr::range(tree, 4, 11))
+//            std::cout << n.mKey << "\t";
+//        std::cout << std::endl;
+
+//        sr::forEachInRange(tree, 4, 11, [](Tree::IntNode const& n) { std::cout << n.mKey << "\t"; });
+//        std::cout << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 18
+//    try {
+//        std::vector<int> v1(1 << 22);
+//        std::vector<int> v2(1 << 21);
+//        std::iota(v1.begin(), v1.end(), 0);
+//        std::iota(v2.begin(), v2.end(), 1 << 20);
+
+//        tp::TaskPool pool;
+
+//        auto start = std::chrono::steady_clock::now();
+//        auto tree1 = bst::createMinimalBST(v1);
+//        auto stop = std::chrono::steady_clock::now();
+//        std::cout << "createMinimalBST: "
+//                  << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count()
+//                  << " ms" << std::endl;
+
+//        tree1.reset();
+
+//        start = std::chrono::steady_clock::now();
+//        tree1 = bst::bulkLoad(v1, pool);
+//        stop = std::chrono::steady_clock::now();
+//        std::cout << "bulkLoad: "
+//                  << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count()
+//                  << " ms" << std::endl;
+
+//        auto tree2 = bst::bulkLoad(v2, pool);
+
+//        start = std::chrono::steady_clock::now();
+//        auto merged = bst::merge(tree1, tree2, pool);
+//        stop = std::chrono::steady_clock::now();
+//        std::cout << "merge: "
+//                  << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count()
+//                  << " ms, size " << merged->mSize << std::endl;
+
+//        std::cout << std::boolalpha << "Is BST: " << vbst::checkBST(merged)
+//                  << ", is balanced: " << bt::isBalanced(merged) << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 19
+    // B+ tree against Node, use 10^8 keys for the real comparison (needs ~10 GB for Node)
+//    try {
+//        const int count = 1 << 22;
+//        std::vector<int> keys(count);
+//        std::iota(keys.begin(), keys.end(), 0);
+
+//        auto measure = [](char const* name, auto && f) {
+//            auto start = std::chrono::steady_clock::now();
+//            auto result = f();
+//            auto stop = std::chrono::steady_clock::now();
+//            std::cout << name << ": " << result << "\t"
+//                      << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count()
+//                      << " ms" << std::endl;
+//        };
+
+//        auto tree = bst::createMinimalBST(keys);
+
+//        std::mt19937 generator(42);
+//        std::shuffle(keys.begin(), keys.end(), generator);
+//        Tree::IntBPlusTree bpTree;
+//        Tree::BPlusTree<int, 64> lineTree; // leaves of one cache line
+//        for (auto && k : keys) {
+//            bpTree.insert(k);
+//            lineTree.insert(k);
+//        }
+
+//        std::vector<int> queries(1 << 22);
+//        for (auto && q : queries)
+//            q = int(generator() % (2 * count));
+
+//        measure("Node lookups", [&] {
+//            std::size_t found = 0;
+//            for (auto && q : queries)
+//                found += !!tree->find(q);
+//            return found;
+//        });
+//        measure("B+ tree lookups", [&] {
+//            std::size_t found = 0;
+//            for (auto && q : queries)
+//                found += bpTree.find(q) != bpTree.end();
+//            return found;
+//        });
+//        measure("B+ tree (64 bytes) lookups", [&] {
+//            std::size_t found = 0;
+//            for (auto && q : queries)
+//                found += lineTree.find(q) != lineTree.end();
+//            return found;
+//        });
+
+//        measure("Node scan", [&] {
+//            long long sum = 0;
+//            for (auto it = sr::begin(tree); it != sr::end(tree); ++it)
+//                sum += it->mKey;
+//            return sum;
+//        });
+//        measure("B+ tree scan", [&] {
+//            long long sum = 0;
+//            for (auto && k : bpTree)
+//                sum += k;
+//            return sum;
+//        });
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 20
+//    try {
+//        std::vector<int> v {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+//        auto tree = bst::createMinimalBST(v);
+//        tree->mLeftChild->mLeftChild->mLeftChild->makeLeftChild(0);
+
+//        Tree::writeSuccinct<int>(tree, "/tmp/tree.bin");
+//        Tree::IntSuccinctTree loaded("/tmp/tree.bin");
+
+//        auto parent = loaded.parent(loaded.find(0));
+//        std::cout << "Size: " << loaded.size()
+//                  << ", parent of 0: " << loaded.key(parent)
+//                  << ", its parent subtree: " << loaded.subtreeSize(loaded.parent(parent)) << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 21
+//    try {
+//        std::vector<int> v {1, 2, 3, 4, 5};
+//        auto tree = bst::createMinimalBST(v);
+
+//        std::vector<int> targets {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+//        auto counts = sp::countPathsWithSums(tree, targets);
+//        for (std::size_t i = 0; i < targets.size(); ++i)
+//            std::cout << targets[i] << ": " << counts[i] << "\t";
+//        std::cout << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 22
+//    try {
+//        std::vector<int> v(1 << 20);
+//        std::iota(v.begin(), v.end(), 1);
+//        tp::TaskPool pool;
+//        auto tree = bst::bulkLoad(v, pool); // Sizes of subtrees are needed
+
+//        const std::size_t count = 1 << 22;
+//        auto start = std::chrono::steady_clock::now();
+//        auto samples = Tree::sampleNodes(tree, count);
+//        auto stop = std::chrono::steady_clock::now();
+//        std::cout << "Batched: " << samples.size() << " samples in "
+//                  << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count()
+//                  << " ms" << std::endl;
+
+//        Tree::FlatSampler<int> uniform(tree);
+//        Tree::FlatSampler<int> weighted(tree, Tree::FlatSampler<int>::KeyWeighted);
+
+//        start = std::chrono::steady_clock::now();
+//        samples = uniform.sample(count);
+//        stop = std::chrono::steady_clock::now();
+//        std::cout << "Flat: " << samples.size() << " samples in "
+//                  << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count()
+//                  << " ms" << std::endl;
+
+//        // Mean key is about 2/3 of the maximum for key weighted sampling
+//        double sum = 0;
+//        for (auto && n : weighted.sample(count))
+//            sum += n->mKey;
+//        std::cout << "Mean of key weighted samples: " << sum / count << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 23
+    // Readers work with snapshots while the writer keeps inserting
+//    try {
+//        Tree::IntVersionedTree tree;
+//        std::atomic<bool> done {false};
+
+//        std::vector<std::pair<std::size_t, std::size_t>> results(4); // Checks and broken snapshots
+//        std::vector<std::thread> readers;
+//        for (auto && result : results) {
+//            readers.emplace_back([&tree, &done, &result] {
+//                std::size_t checks = 0, broken = 0;
+//                while (!done) {
+//                    auto snapshot = tree.snapshot();
+
+//                    std::size_t count = 0;
+//                    int previous = std::numeric_limits<int>::min();
+//                    snapshot->forEach([&](int k) { broken += k < previous; previous = k; ++count; });
+//                    broken += count != snapshot->size();
+//                    ++checks;
+//                }
+
+//                result = {checks, broken};
+//            });
+//        }
+
+//        std::mt19937 generator(42);
+//        for (int i = 0; i < 100000; ++i)
+//            tree.insert(int(generator() % 1000000));
+//        done = true;
+
+//        for (auto && r : readers)
+//            r.join();
+
+//        for (auto && result : results)
+//            std::cout << "Checks: " << result.first << ", broken: " << result.second << std::endl;
+
+//        auto old = *tree.snapshot();
+//        auto updated = old.insert(-1);
+//        std::cout << std::boolalpha << old.contains(-1) << " " << updated.contains(-1) << " "
+//                  << updated.size() << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 24
+    // Throughput of the concurrent set and of Node under one mutex, for 1-32 threads and
+    // 50%, 90% and 99% of reads
+//    try {
+//        const int keysRange = 1 << 22;
+//        const int operationsPerThread = 1 << 18;
+
+//        auto run = [&](char const* name, int threads, int readPercent, auto && insert, auto && find) {
+//            std::vector<std::thread> workers;
+//            auto start = std::chrono::steady_clock::now();
+//            for (int t = 0; t < threads; ++t) {
+//                workers.emplace_back([&, t] {
+//                    std::mt19937 generator(t);
+//                    for (int i = 0; i < operationsPerThread; ++i) {
+//                        int k = int(generator() % keysRange);
+//                        if (int(generator() % 100) < readPercent)
+//                            find(k);
+//                        else
+//                            insert(k);
+//                    }
+//                });
+//            }
+//            for (auto && w : workers)
+//                w.join();
+//            auto stop = std::chrono::steady_clock::now();
+
+//            double seconds = std::chrono::duration<double>(stop - start).count();
+//            std::cout << name << "\tthreads: " << threads << "\treads: " << readPercent << "%\t"
+//                      << threads * operationsPerThread / seconds / 1e6 << " Mops/s" << std::endl;
+//        };
+
+//        for (int readPercent : {50, 90, 99}) {
+//            for (int threads = 1; threads <= 32; threads *= 2) {
+//                Tree::IntConcurrentSet set;
+//                run("Concurrent set", threads, readPercent,
+//                    [&](int k) { set.insert(k); }, [&](int k) { return set.contains(k); });
+
+//                std::mutex mutex;
+//                auto tree = std::make_shared<Tree::IntNode>(keysRange / 2);
+//                run("Locked Node", threads, readPercent,
+//                    [&](int k) { std::lock_guard<std::mutex> l(mutex); tree->insertInOrder(k); },
+//                    [&](int k) { std::lock_guard<std::mutex> l(mutex); return !!tree->find(k); });
+//            }
+//        }
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 25
+//    // Lookup table is built and queried at compile time
+//    {
+//        constexpr auto table = Tree::makeStaticBST(std::array<int, 10> {{2, 3, 5, 7, 11, 13, 17, 19, 23, 29}});
+
+//        static_assert(table.contains(17) && !table.contains(18), "Wrong lookup.");
+//        static_assert(table.key(table.successor(19)) == 23, "Wrong successor.");
+//        static_assert(table.successor(29) == table.npos, "There is no successor for the maximum.");
+
+//        std::cout << "Successor of 8: " << table.key(table.successor(8)) << std::endl;
+//    }
+
+    // 26
+//    // Depth is kept in nodes, moving a subtree updates it once
+//    try {
+//        auto root = bst::createMinimalBST({1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15});
+//        auto leaf = root->find(15);
+//        std::cout << "Depth of 15: " << leaf->depth() << std::endl;
+
+//        // Move the left subtree under the rightmost leaf
+//        auto left = root->mLeftChild;
+//        root->setLeftChild(nullptr);
+//        leaf->setRightChild(left);
+//        std::cout << "Depth of 1 after move: " << left->find(1)->depth() << std::endl;
+//        std::cout << "Common ancestor of 1 and 7: " << fca::commonAncestor(left->find(1), left->find(7))->mKey << std::endl;
+
+//        // Cycle
+//        left->find(1)->setLeftChild(root);
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 27
+    // Sum of keys in range, aggregates of subtrees vs. full scan
     try {
-        std::vector<int> v {1, 2, 3, 4, 5};
-        auto tree = bst::createMinimalBST(v);
+        const int count = 1000000;
+        const int queries = 1000;
+
+        std::mt19937 generator(27);
+        Tree::IntSumTree tree;
+        std::vector<int> keys(count);
+        for (auto && k : keys) {
+            k = int(generator() % 1000);
+            tree.insert(k);
+        }
 
-        std::cout << sp::countPathWithSum(tree, 3) << std::endl;
+        long long scanSum = 0, treeSum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int q = 0; q < queries; ++q)
+            for (auto && k : keys)
+                if (k >= q % 900 && k <= q % 900 + 100)
+                    scanSum += k;
+        auto middle = std::chrono::steady_clock::now();
+        for (int q = 0; q < queries; ++q)
+            treeSum += tree.aggregate(q % 900, q % 900 + 100);
+        auto stop = std::chrono::steady_clock::now();
+
+        std::cout << "Same sums: " << std::boolalpha << (scanSum == treeSum) << std::endl;
+        std::cout << "Scan: " << std::chrono::duration<double, std::milli>(middle - start).count() << " ms, "
+                  << "tree: " << std::chrono::duration<double, std::milli>(stop - middle).count() << " ms" << std::endl;
     } catch (std::exception const& e) {
         std::cout << e.what() << std::endl;
     }
@@ -4,7 +4,10 @@
 #include <memory>
 #include <fstream>
 #include <iostream>
+#include <random>
+#include <stdexcept>
 #include <stdlib.h>
+#include <vector>
 
 namespace Tree {
 
@@ -17,8 +20,8 @@ namespace Tree {
       using WPtr = std::weak_ptr<Node<Key>>;
 
       Node() {}
-      Node(const Ptr &p) : mParent(p) {}
-      Node(Key k, Color c = None, const Ptr &p = nullptr) : mParent(p), mColor(c), mKey(k) {}
+      Node(const Ptr &p) : mParent(p), mDepth(p ? p->mDepth + 1 : 0) {}
+      Node(Key k, Color c = None, const Ptr &p = nullptr) : mParent(p), mColor(c), mDepth(p ? p->mDepth + 1 : 0), mKey(k) {}
 
       Ptr makeLeftChild(Key k, Color c = None)  { return mLeftChild  = std::make_shared<Node<Key>>(k, c, ptr()); }
       Ptr makeRightChild(Key k, Color c = None) { return mRightChild = std::make_shared<Node<Key>>(k, c, ptr()); }
@@ -46,23 +49,39 @@ namespace Tree {
 
       Ptr setChild(Ptr & child, Ptr const& n)
       {
-          if (n)
+          if (n) {
+              n->updateDepth(mDepth + 1, this);
               n->mParent = ptr();
+          }
           return child = n;
       }
 
-      int depth() const
+      int depth() const { return mDepth; }
+
+      /// Sets depth for the subtree moved to the new place. The subtree is consistent, so nothing
+      /// is done if its root is already at this depth. Throws if the new parent is in the subtree.
+      void updateDepth(int depth, const Node *newParent = nullptr)
       {
-          Ptr p = parent();
-          int d = 0;
-          while (p) {
-              if (p.get() == this)
-                  throw std::logic_error("There is a cycle. Cannot determine depth.");
-
-              p = p->parent();
-              ++d;
+          if (mDepth == depth)
+              return;
+
+          const int oldDepth = mDepth;
+          std::vector<std::pair<Node *, int>> stack {{this, depth}};
+          while (!stack.empty()) {
+              auto top = stack.back();
+              stack.pop_back();
+
+              if (top.first == newParent) {
+                  updateDepth(oldDepth);
+                  throw std::logic_error("There is a cycle. Cannot attach node to own subtree.");
+              }
+
+              top.first->mDepth = top.second;
+              if (top.first->mLeftChild)
+                  stack.push_back({top.first->mLeftChild.get(), top.second + 1});
+              if (top.first->mRightChild)
+                  stack.push_back({top.first->mRightChild.get(), top.second + 1});
           }
-          return d;
       }
 
       Ptr randomNode()
@@ -71,7 +90,7 @@ namespace Tree {
           int index = rand() % mSize;
           if (index < leftSize)
               return mLeftChild->randomNode();
-          else if (index == mSize || !mRightChild)
+          else if (index == leftSize || !mRightChild)
                return ptr();
           else
               return mRightChild->randomNode();
@@ -79,6 +98,20 @@ namespace Tree {
           throw std::logic_error("Cannot give you a random node.");
       }
 
+      /// Same as above, but with own generator and without modulo bias
+      template <class Generator>
+      Ptr randomNode(Generator &generator)
+      {
+          int leftSize = mLeftChild ? mLeftChild->mSize : 0;
+          int index = std::uniform_int_distribution<int>(0, mSize - 1)(generator);
+          if (index < leftSize)
+              return mLeftChild->randomNode(generator);
+          else if (index == leftSize || !mRightChild)
+              return ptr();
+          else
+              return mRightChild->randomNode(generator);
+      }
+
       Ptr insertInOrder(Key k)
       {
           Ptr result;
@@ -95,7 +128,7 @@ namespace Tree {
       Ptr find(Key k)
       {
           if (mKey == k)
-              return this;
+              return ptr();
           else if (k <= mKey)
               return mLeftChild ? mLeftChild->find(k) : nullptr;
           else if (k > mKey)
@@ -134,6 +167,8 @@ namespace Tree {
 
       Color mColor = None;
 
+      int mDepth = 0;
+
       Key mKey = 0;
 
       Key mSize = 1;
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "node.h"
+
+namespace Tree {
+
+   /// Immutable red-black tree. Insertion copies only the path from the root to the new node and
+   /// returns a new version, all other nodes are shared between versions. A version is a plain
+   /// handle, reading it needs no locks, nodes are released when no version references them.
+   template <class Key>
+   class PersistentTree
+   {
+      using Color = typename Node<Key>::Color;
+
+      struct PNode
+      {
+         using Ptr = std::shared_ptr<const PNode>;
+
+         PNode(Color c, Ptr l, Key k, Ptr r) : mLeftChild(std::move(l)), mRightChild(std::move(r)), mColor(c), mKey(k) {}
+
+         Ptr mLeftChild;
+         Ptr mRightChild;
+         Color mColor;
+         Key mKey;
+      };
+
+      using Ptr = typename PNode::Ptr;
+
+   public:
+      PersistentTree() {}
+
+      std::size_t size() const { return mSize; }
+      bool empty() const { return mSize == 0; }
+
+      /// New version with the key, this one stays untouched
+      PersistentTree insert(const Key &k) const
+      {
+         Ptr root = insertImpl(mRoot, k);
+         if (root->mColor == Node<Key>::Red)
+            root = make(Node<Key>::Black, root->mLeftChild, root->mKey, root->mRightChild);
+
+         return PersistentTree(std::move(root), mSize + 1);
+      }
+
+      bool contains(const Key &k) const
+      {
+         for (const PNode *node = mRoot.get(); node; ) {
+            if (node->mKey == k)
+               return true;
+            node = k <= node->mKey ? node->mLeftChild.get() : node->mRightChild.get();
+         }
+         return false;
+      }
+
+      /// In-order traversal
+      template <class F>
+      void forEach(F &&f) const { forEachImpl(mRoot.get(), f); }
+
+   private:
+      PersistentTree(Ptr root, std::size_t size) : mRoot(std::move(root)), mSize(size) {}
+
+      static Ptr make(Color c, Ptr l, const Key &k, Ptr r)
+      {
+         return std::make_shared<const PNode>(c, std::move(l), k, std::move(r));
+      }
+
+      static bool isRed(const Ptr &n) { return n && n->mColor == Node<Key>::Red; }
+
+      static Ptr insertImpl(const Ptr &node, const Key &k)
+      {
+         if (!node)
+            return make(Node<Key>::Red, nullptr, k, nullptr);
+
+         // Equal keys go to the left, as for Node::insertInOrder
+         if (k <= node->mKey)
+            return balance(node->mColor, insertImpl(node->mLeftChild, k), node->mKey, node->mRightChild);
+         else
+            return balance(node->mColor, node->mLeftChild, node->mKey, insertImpl(node->mRightChild, k));
+      }
+
+      /// Four cases of a red node with a red child under a black one, all become the same shape
+      static Ptr balance(Color c, const Ptr &l, const Key &k, const Ptr &r)
+      {
+         const Color red = Node<Key>::Red, black = Node<Key>::Black;
+
+         if (c == black) {
+            if (isRed(l) && isRed(l->mLeftChild)) {
+               const Ptr &ll = l->mLeftChild;
+               return make(red, make(black, ll->mLeftChild, ll->mKey, ll->mRightChild), l->mKey,
+                           make(black, l->mRightChild, k, r));
+            }
+            if (isRed(l) && isRed(l->mRightChild)) {
+               const Ptr &lr = l->mRightChild;
+               return make(red, make(black, l->mLeftChild, l->mKey, lr->mLeftChild), lr->mKey,
+                           make(black, lr->mRightChild, k, r));
+            }
+            if (isRed(r) && isRed(r->mLeftChild)) {
+               const Ptr &rl = r->mLeftChild;
+               return make(red, make(black, l, k, rl->mLeftChild), rl->mKey,
+                           make(black, rl->mRightChild, r->mKey, r->mRightChild));
+            }
+            if (isRed(r) && isRed(r->mRightChild)) {
+               const Ptr &rr = r->mRightChild;
+               return make(red, make(black, l, k, r->mLeftChild), r->mKey,
+                           make(black, rr->mLeftChild, rr->mKey, rr->mRightChild));
+            }
+         }
+
+         return make(c, l, k, r);
+      }
+
+      template <class F>
+      static void forEachImpl(const PNode *node, F &f)
+      {
+         if (!node)
+            return;
+
+         forEachImpl(node->mLeftChild.get(), f);
+         f(node->mKey);
+         forEachImpl(node->mRightChild.get(), f);
+      }
+
+      Ptr mRoot;
+      std::size_t mSize = 0;
+   };
+
+   /// The latest version for one writer and many readers. Readers take a snapshot and work with it
+   /// as long as they want, the writer publishes new versions without waiting for them.
+   template <class Key>
+   class VersionedTree
+   {
+   public:
+      using Version = PersistentTree<Key>;
+
+      VersionedTree() : mCurrent(std::make_shared<const Version>()) {}
+
+      std::shared_ptr<const Version> snapshot() const { return std::atomic_load(&mCurrent); }
+
+      /// Must be called from one writer thread at a time
+      void insert(const Key &k)
+      {
+         auto next = std::make_shared<const Version>(snapshot()->insert(k));
+         std::atomic_store(&mCurrent, std::move(next));
+      }
+
+   private:
+      std::shared_ptr<const Version> mCurrent;
+   };
+
+   using IntPersistentTree = PersistentTree<int>;
+   using IntVersionedTree = VersionedTree<int>;
+
+} // namespace Tree
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "node.h"
+
+namespace Tree {
+
+   /// xoshiro256** generator, a few cycles per number and good enough statistical quality
+   class Xoshiro256
+   {
+   public:
+      using result_type = std::uint64_t;
+
+      explicit Xoshiro256(std::uint64_t seed = 0x9E3779B97F4A7C15ull)
+      {
+         // splitmix64 spreads one seed over the whole state
+         for (auto &&s : mState) {
+            seed += 0x9E3779B97F4A7C15ull;
+            std::uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            s = z ^ (z >> 31);
+         }
+      }
+
+      static constexpr result_type min() { return 0; }
+      static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+      result_type operator ()()
+      {
+         const std::uint64_t result = rotl(mState[1] * 5, 7) * 9;
+         const std::uint64_t t = mState[1] << 17;
+
+         mState[2] ^= mState[0];
+         mState[3] ^= mState[1];
+         mState[1] ^= mState[2];
+         mState[0] ^= mState[3];
+         mState[2] ^= t;
+         mState[3] = rotl(mState[3], 45);
+
+         return result;
+      }
+
+   private:
+      static std::uint64_t rotl(std::uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+      std::uint64_t mState[4];
+   };
+
+   /// Generator of the calling thread, so sampling from many threads needs no synchronization
+   inline Xoshiro256 &threadGenerator()
+   {
+      static thread_local Xoshiro256 generator(std::random_device{}() ^
+                                               std::hash<std::thread::id>()(std::this_thread::get_id()));
+      return generator;
+   }
+
+   /// Unbiased number in [0, bound) with one multiplication in most cases (Lemire's method)
+   template <class Generator>
+   std::uint64_t uniformIndex(Generator &generator, std::uint64_t bound)
+   {
+      unsigned __int128 m = (unsigned __int128)generator() * bound;
+      std::uint64_t low = std::uint64_t(m);
+      if (low < bound) {
+         const std::uint64_t threshold = -bound % bound;
+         while (low < threshold) {
+            m = (unsigned __int128)generator() * bound;
+            low = std::uint64_t(m);
+         }
+      }
+      return std::uint64_t(m >> 64);
+   }
+
+   namespace details {
+
+      template <class Key>
+      std::size_t sizeOf(const typename Node<Key>::Ptr &node) { return node ? std::size_t(node->mSize) : 0; }
+
+      // Ranks in [first, last) are sorted, so nodes on a common part of the path are visited once
+      template <class Key, class RankIt, class OutIt>
+      void selectRanks(Node<Key> *node, RankIt first, RankIt last, std::size_t offset, OutIt &out)
+      {
+         if (first == last)
+            return;
+
+         const std::size_t rootRank = offset + sizeOf<Key>(node->mLeftChild);
+         RankIt equal = std::lower_bound(first, last, rootRank);
+         RankIt greater = std::upper_bound(equal, last, rootRank);
+
+         if (first != equal)
+            selectRanks(node->mLeftChild.get(), first, equal, offset, out);
+         for (; equal != greater; ++equal)
+            *out++ = node;
+         if (greater != last)
+            selectRanks(node->mRightChild.get(), greater, last, rootRank + 1, out);
+      }
+
+   } // namespace details
+
+   /// k uniformly chosen nodes (with repetitions) in the in-order order. Sizes of subtrees must be
+   /// maintained, i.e. tree is built with insertInOrder or bulk loaded.
+   template <class Key, class Generator = Xoshiro256>
+   std::vector<Node<Key> *> sampleNodes(const std::shared_ptr<Node<Key>> &root, std::size_t k,
+                                        Generator &generator = threadGenerator())
+   {
+      std::vector<Node<Key> *> result;
+      if (!root || k == 0)
+         return result;
+
+      std::vector<std::size_t> ranks(k);
+      for (auto &&r : ranks)
+         r = std::size_t(uniformIndex(generator, std::uint64_t(root->mSize)));
+      std::sort(ranks.begin(), ranks.end());
+
+      result.reserve(k);
+      auto out = std::back_inserter(result);
+      details::selectRanks(root.get(), ranks.begin(), ranks.end(), 0, out);
+      return result;
+   }
+
+   /// Sampler for static trees: nodes are flattened into an array, uniform sample is O(1).
+   /// Key weighted sampling is O(1) as well, with alias table built by Vose's method.
+   template <class Key>
+   class FlatSampler
+   {
+   public:
+      enum Mode {Uniform, KeyWeighted};
+
+      explicit FlatSampler(const typename Node<Key>::Ptr &root, Mode mode = Uniform)
+      {
+         flatten(root.get());
+         if (mode == KeyWeighted)
+            buildAliasTable();
+      }
+
+      std::size_t size() const { return mNodes.size(); }
+
+      template <class Generator = Xoshiro256>
+      Node<Key> *sample(Generator &generator = threadGenerator()) const
+      {
+         if (mNodes.empty())
+            throw std::logic_error("Cannot give you a random node.");
+
+         std::size_t i = std::size_t(uniformIndex(generator, mNodes.size()));
+         if (mProbabilities.empty())
+            return mNodes[i];
+
+         // 53 random bits make a double in [0, 1)
+         double coin = double(generator() >> 11) * (1.0 / 9007199254740992.0);
+         return mNodes[coin < mProbabilities[i] ? i : mAliases[i]];
+      }
+
+      template <class Generator = Xoshiro256>
+      std::vector<Node<Key> *> sample(std::size_t k, Generator &generator = threadGenerator()) const
+      {
+         std::vector<Node<Key> *> result(k);
+         for (auto &&n : result)
+            n = sample(generator);
+         return result;
+      }
+
+   private:
+      void flatten(Node<Key> *node)
+      {
+         if (!node)
+            return;
+
+         flatten(node->mLeftChild.get());
+         mNodes.push_back(node);
+         flatten(node->mRightChild.get());
+      }
+
+      void buildAliasTable()
+      {
+         double total = 0;
+         for (auto &&n : mNodes) {
+            if (n->mKey < 0)
+               throw std::invalid_argument("Weights (keys) cannot be negative.");
+            total += double(n->mKey);
+         }
+         if (total <= 0)
+            throw std::invalid_argument("Sum of weights (keys) must be positive.");
+
+         const std::size_t size = mNodes.size();
+         mProbabilities.resize(size);
+         mAliases.resize(size);
+
+         std::vector<std::size_t> small, large;
+         for (std::size_t i = 0; i < size; ++i) {
+            mProbabilities[i] = double(mNodes[i]->mKey) * size / total;
+            (mProbabilities[i] < 1 ? small : large).push_back(i);
+         }
+
+         while (!small.empty() && !large.empty()) {
+            std::size_t s = small.back(), l = large.back();
+            small.pop_back();
+
+            mAliases[s] = l;
+            mProbabilities[l] -= 1 - mProbabilities[s];
+            if (mProbabilities[l] < 1) {
+               large.pop_back();
+               small.push_back(l);
+            }
+         }
+
+         // Leftovers are one up to rounding errors
+         for (auto &&i : small)
+            mProbabilities[i] = 1;
+         for (auto &&i : large)
+            mProbabilities[i] = 1;
+      }
+
+      std::vector<Node<Key> *> mNodes;
+      std::vector<double> mProbabilities;
+      std::vector<std::size_t> mAliases;
+   };
+
+} // namespace Tree
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+
+namespace Tree {
+
+   /// Balanced BST built at compile time from sorted keys. Keys are stored in Eytzinger (BFS)
+   /// order, children of i are 2i + 1 and 2i + 2, so there are no nodes, pointers and allocations,
+   /// and lookups on constant tables can be folded by the compiler.
+   template <class Key, std::size_t N>
+   class StaticBST
+   {
+   public:
+      static constexpr std::size_t npos = N;
+
+      constexpr explicit StaticBST(const std::array<Key, N> &sorted) : mKeys{}
+      {
+         for (std::size_t i = 1; i < N; ++i)
+            if (sorted[i] < sorted[i - 1])
+               throw std::invalid_argument("Keys must be sorted.");
+
+         std::size_t next = 0;
+         fill(sorted, next, 0);
+      }
+
+      constexpr std::size_t size() const { return N; }
+      constexpr const Key &key(std::size_t index) const { return mKeys[index]; }
+
+      /// Index of the key or npos
+      constexpr std::size_t find(const Key &k) const
+      {
+         std::size_t i = 0;
+         while (i < N) {
+            if (mKeys[i] == k)
+               return i;
+            i = k < mKeys[i] ? 2 * i + 1 : 2 * i + 2;
+         }
+         return npos;
+      }
+
+      constexpr bool contains(const Key &k) const { return find(k) != npos; }
+
+      /// Index of the first key not less than k or npos
+      constexpr std::size_t lowerBound(const Key &k) const
+      {
+         std::size_t result = npos;
+         for (std::size_t i = 0; i < N; ) {
+            if (!(mKeys[i] < k)) {
+               result = i;
+               i = 2 * i + 1;
+            } else
+               i = 2 * i + 2;
+         }
+         return result;
+      }
+
+      /// Index of the first key greater than k or npos
+      constexpr std::size_t successor(const Key &k) const
+      {
+         std::size_t result = npos;
+         for (std::size_t i = 0; i < N; ) {
+            if (k < mKeys[i]) {
+               result = i;
+               i = 2 * i + 1;
+            } else
+               i = 2 * i + 2;
+         }
+         return result;
+      }
+
+   private:
+      // In-order walk over the implicit tree takes sorted keys one by one
+      constexpr void fill(const std::array<Key, N> &sorted, std::size_t &next, std::size_t i)
+      {
+         if (i >= N)
+            return;
+
+         fill(sorted, next, 2 * i + 1);
+         mKeys[i] = sorted[next++];
+         fill(sorted, next, 2 * i + 2);
+      }
+
+      Key mKeys[N ? N : 1];
+   };
+
+   template <class Key, std::size_t N>
+   constexpr std::size_t StaticBST<Key, N>::npos;
+
+   template <class Key, std::size_t N>
+   constexpr StaticBST<Key, N> makeStaticBST(const std::array<Key, N> &sorted)
+   {
+      return StaticBST<Key, N>(sorted);
+   }
+
+} // namespace Tree
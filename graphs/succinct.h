@@ -0,0 +1,256 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "node.h"
+
+namespace Tree {
+
+   /// Binary format of a tree:
+   ///   header;
+   ///   shape, two bits per node in level order, set if node has left and right child respectively;
+   ///   ranks, number of set bits before every block of RANK_BLOCK_WORDS words of the shape;
+   ///   keys in level order.
+   /// Node id is its position in level order, so the children of node i are the ones denoted by
+   /// bits 2i and 2i + 1, and their ids are numbers of set bits before them plus one.
+   namespace succinct {
+
+      static const char MAGIC[8] = {'T', 'R', 'E', 'E', 'S', 'U', 'C', 'C'};
+      static const std::uint32_t VERSION = 1;
+      static const std::uint64_t RANK_BLOCK_WORDS = 8;
+      static const std::uint64_t NONE = ~std::uint64_t(0);
+
+      struct Header
+      {
+         char magic[8];
+         std::uint32_t version;
+         std::uint32_t keySize;
+         std::uint64_t nodesCount;
+         std::uint64_t wordsCount;
+         std::uint64_t ranksCount;
+      };
+
+      inline std::uint64_t wordsFor(std::uint64_t nodesCount) { return (2 * nodesCount + 63) / 64; }
+      inline std::uint64_t ranksFor(std::uint64_t wordsCount) { return wordsCount / RANK_BLOCK_WORDS + 1; }
+
+      inline std::uint64_t fileSize(const Header &h)
+      {
+         return sizeof(Header) + (h.wordsCount + h.ranksCount) * sizeof(std::uint64_t) + h.nodesCount * h.keySize;
+      }
+
+   } // namespace succinct
+
+   template <class Key>
+   void writeSuccinct(const typename Node<Key>::Ptr &root, const std::string &path)
+   {
+      static_assert(std::is_trivially_copyable<Key>::value, "Keys are stored as is.");
+
+      // Level order, the buffer is the queue of BFS
+      std::vector<const Node<Key> *> nodes;
+      if (root)
+         nodes.push_back(root.get());
+      for (std::size_t i = 0; i < nodes.size(); ++i) {
+         if (nodes[i]->mLeftChild)
+            nodes.push_back(nodes[i]->mLeftChild.get());
+         if (nodes[i]->mRightChild)
+            nodes.push_back(nodes[i]->mRightChild.get());
+      }
+
+      succinct::Header header;
+      std::memcpy(header.magic, succinct::MAGIC, sizeof(header.magic));
+      header.version = succinct::VERSION;
+      header.keySize = sizeof(Key);
+      header.nodesCount = nodes.size();
+      header.wordsCount = succinct::wordsFor(nodes.size());
+      header.ranksCount = succinct::ranksFor(header.wordsCount);
+
+      std::vector<std::uint64_t> bits(header.wordsCount);
+      std::vector<Key> keys(nodes.size());
+      for (std::size_t i = 0; i < nodes.size(); ++i) {
+         if (nodes[i]->mLeftChild)
+            bits[2 * i / 64] |= std::uint64_t(1) << (2 * i % 64);
+         if (nodes[i]->mRightChild)
+            bits[(2 * i + 1) / 64] |= std::uint64_t(1) << ((2 * i + 1) % 64);
+         keys[i] = nodes[i]->mKey;
+      }
+
+      std::vector<std::uint64_t> ranks(header.ranksCount);
+      std::uint64_t ones = 0;
+      for (std::uint64_t w = 0; w < header.wordsCount; ++w) {
+         if (w % succinct::RANK_BLOCK_WORDS == 0)
+            ranks[w / succinct::RANK_BLOCK_WORDS] = ones;
+         ones += __builtin_popcountll(bits[w]);
+      }
+      if (header.wordsCount % succinct::RANK_BLOCK_WORDS == 0)
+         ranks.back() = ones;
+
+      std::ofstream out(path, std::ofstream::out | std::ofstream::binary);
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      out.write(reinterpret_cast<const char *>(bits.data()), bits.size() * sizeof(std::uint64_t));
+      out.write(reinterpret_cast<const char *>(ranks.data()), ranks.size() * sizeof(std::uint64_t));
+      out.write(reinterpret_cast<const char *>(keys.data()), keys.size() * sizeof(Key));
+      out.close();
+
+      if (!out)
+         throw std::runtime_error("Cannot write the tree to " + path);
+   }
+
+   /// Read-only view of the tree written by writeSuccinct. The file is mapped into memory and all
+   /// navigation works on the encoded form, nothing is decoded on load.
+   template <class Key>
+   class SuccinctTree
+   {
+   public:
+      using Id = std::uint64_t;
+
+      explicit SuccinctTree(const std::string &path)
+      {
+         int fd = ::open(path.c_str(), O_RDONLY);
+         if (fd < 0)
+            throw std::runtime_error("Cannot open " + path);
+
+         struct stat st;
+         if (::fstat(fd, &st) != 0 || std::uint64_t(st.st_size) < sizeof(succinct::Header)) {
+            ::close(fd);
+            throw std::runtime_error("Not a tree file: " + path);
+         }
+
+         mSize = std::size_t(st.st_size);
+         mData = ::mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+         ::close(fd);
+         if (mData == MAP_FAILED)
+            throw std::runtime_error("Cannot map " + path);
+
+         mHeader = static_cast<const succinct::Header *>(mData);
+         if (std::memcmp(mHeader->magic, succinct::MAGIC, sizeof(succinct::MAGIC)) != 0 ||
+             mHeader->version != succinct::VERSION || mHeader->keySize != sizeof(Key) ||
+             succinct::fileSize(*mHeader) != mSize) {
+            ::munmap(mData, mSize);
+            throw std::runtime_error("Not a tree file or incompatible key: " + path);
+         }
+
+         mBits  = reinterpret_cast<const std::uint64_t *>(mHeader + 1);
+         mRanks = mBits + mHeader->wordsCount;
+         mKeys  = reinterpret_cast<const Key *>(mRanks + mHeader->ranksCount);
+      }
+
+      ~SuccinctTree()
+      {
+         if (mData)
+            ::munmap(mData, mSize);
+      }
+
+      SuccinctTree(const SuccinctTree &) = delete;
+      SuccinctTree &operator =(const SuccinctTree &) = delete;
+
+      std::uint64_t size() const { return mHeader->nodesCount; }
+      bool empty() const { return size() == 0; }
+
+      Id root() const { return empty() ? succinct::NONE : 0; }
+      Key key(Id node) const { return mKeys[node]; }
+
+      Id leftChild(Id node) const  { return child(2 * node); }
+      Id rightChild(Id node) const { return child(2 * node + 1); }
+
+      Id parent(Id node) const
+      {
+         // Node is the n-th set bit, the bit belongs to the node at half of its position
+         return node == 0 || node == succinct::NONE ? succinct::NONE : select(node) / 2;
+      }
+
+      /// Children of a contiguous range of one level are contiguous on the next level, O(height)
+      std::uint64_t subtreeSize(Id node) const
+      {
+         std::uint64_t count = 0;
+         for (Id from = node, to = node + 1; from < to; ) {
+            count += to - from;
+            Id nextFrom = rank(2 * from) + 1;
+            to = rank(2 * to) + 1;
+            from = nextFrom;
+         }
+         return count;
+      }
+
+      /// BST search directly on the encoded tree
+      Id find(const Key &k) const
+      {
+         Id node = root();
+         while (node != succinct::NONE) {
+            if (key(node) == k)
+               return node;
+            node = k <= key(node) ? leftChild(node) : rightChild(node);
+         }
+         return succinct::NONE;
+      }
+
+   private:
+      bool bit(std::uint64_t position) const { return (mBits[position / 64] >> (position % 64)) & 1; }
+
+      Id child(std::uint64_t position) const { return bit(position) ? rank(position) + 1 : succinct::NONE; }
+
+      /// Number of set bits before the position
+      std::uint64_t rank(std::uint64_t position) const
+      {
+         const std::uint64_t word = position / 64;
+         const std::uint64_t block = word / succinct::RANK_BLOCK_WORDS;
+
+         std::uint64_t ones = mRanks[block];
+         for (std::uint64_t w = block * succinct::RANK_BLOCK_WORDS; w < word; ++w)
+            ones += __builtin_popcountll(mBits[w]);
+         if (position % 64)
+            ones += __builtin_popcountll(mBits[word] & ((std::uint64_t(1) << (position % 64)) - 1));
+
+         return ones;
+      }
+
+      /// Position of the n-th (1-based) set bit
+      std::uint64_t select(std::uint64_t n) const
+      {
+         // The last block which has less than n set bits before it
+         std::uint64_t lo = 0, hi = mHeader->ranksCount;
+         while (hi - lo > 1) {
+            std::uint64_t mid = (lo + hi) / 2;
+            if (mRanks[mid] < n)
+               lo = mid;
+            else
+               hi = mid;
+         }
+
+         std::uint64_t ones = mRanks[lo];
+         std::uint64_t word = lo * succinct::RANK_BLOCK_WORDS;
+         for (; ; ++word) {
+            std::uint64_t count = __builtin_popcountll(mBits[word]);
+            if (ones + count >= n)
+               break;
+            ones += count;
+         }
+
+         std::uint64_t bits = mBits[word];
+         for (std::uint64_t i = ones + 1; i < n; ++i)
+            bits &= bits - 1; // Drop the lowest set bit
+         return word * 64 + __builtin_ctzll(bits);
+      }
+
+      void *mData = nullptr;
+      std::size_t mSize = 0;
+
+      const succinct::Header *mHeader = nullptr;
+      const std::uint64_t *mBits = nullptr;
+      const std::uint64_t *mRanks = nullptr;
+      const Key *mKeys = nullptr;
+   };
+
+   using IntSuccinctTree = SuccinctTree<int>;
+
+} // namespace Tree
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tp
+{
+    /// Depth of the tree up to which subtrees are spawned as separate tasks. Gives 2^8 leaf tasks,
+    /// enough to keep a few dozens of cores busy, while spawning overhead stays negligible.
+    static const int DEFAULT_CUTOFF_DEPTH = 8;
+
+    /// Small work-stealing pool for fork-join recursion. Every worker has own deque of tasks, it
+    /// pushes and pops from the back and steals from the front of deques of other workers.
+    /// The thread waiting for a spawned task executes pending tasks instead of blocking, so nested
+    /// spawns cannot deadlock the pool.
+    class TaskPool
+    {
+    public: // Types
+        using Task = std::function<void()>;
+
+    public: // Methods
+        explicit TaskPool(std::size_t workersCount = std::thread::hardware_concurrency())
+            : m_queues(std::max<std::size_t>(workersCount, 1) + 1 /*for external threads*/)
+        {
+            for (std::size_t i = 0; i + 1 < m_queues.size(); ++i)
+                m_workers.emplace_back([this, i] { workerLoop(i); });
+        }
+
+        ~TaskPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_sleepMutex);
+                m_done = true;
+            }
+            m_wakeUp.notify_all();
+
+            for (auto && w : m_workers)
+                w.join();
+        }
+
+        TaskPool(TaskPool const&) = delete;
+        TaskPool & operator =(TaskPool const&) = delete;
+
+        std::size_t workersCount() const { return m_workers.size(); }
+
+        template <class F>
+        auto spawn(F && f) -> std::future<decltype(f())>
+        {
+            using Result = decltype(f());
+
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+            auto result = task->get_future();
+            push([task] { (*task)(); });
+
+            return result;
+        }
+
+        /// Help to execute pending tasks until the result is ready
+        template <class R>
+        R wait(std::future<R> & f)
+        {
+            while (f.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                if (!runPending())
+                    std::this_thread::yield();
+
+            return f.get();
+        }
+
+    private: // Types
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        struct Local
+        {
+            TaskPool const* pool = nullptr;
+            std::size_t index = 0;
+        };
+
+    private: // Methods
+        static Local & local()
+        {
+            static thread_local Local l;
+            return l;
+        }
+
+        /// Own queue for workers, shared one for all other threads
+        std::size_t currentQueue() const
+        {
+            auto && l = local();
+            return l.pool == this ? l.index : m_queues.size() - 1;
+        }
+
+        void push(Task task)
+        {
+            auto && queue = m_queues[currentQueue()];
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.tasks.push_back(std::move(task));
+                ++m_pending;
+            }
+
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_wakeUp.notify_one();
+        }
+
+        bool runPending()
+        {
+            Task task;
+            const std::size_t own = currentQueue();
+
+            for (std::size_t i = 0; i < m_queues.size() && !task; ++i) {
+                auto && queue = m_queues[(own + i) % m_queues.size()];
+
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (queue.tasks.empty())
+                    continue;
+
+                // Newest task from the own queue (it's hot in cache), oldest one from others
+                if (i == 0) {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                } else {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                --m_pending;
+            }
+
+            if (!task)
+                return false;
+
+            task();
+            return true;
+        }
+
+        void workerLoop(std::size_t index)
+        {
+            local().pool  = this;
+            local().index = index;
+
+            while (true) {
+                if (runPending())
+                    continue;
+
+                std::unique_lock<std::mutex> lock(m_sleepMutex);
+                m_wakeUp.wait(lock, [this] { return m_pending > 0 || m_done; });
+                if (m_done && m_pending == 0)
+                    return;
+            }
+        }
+
+    private: // Data
+        std::vector<Queue> m_queues;
+        std::vector<std::thread> m_workers;
+
+        std::atomic<std::size_t> m_pending {0};
+
+        std::mutex m_sleepMutex;
+        std::condition_variable m_wakeUp;
+        bool m_done = false;
+    };
+}
@@ -0,0 +1,11 @@
+TEMPLATE = app
+CONFIG += console c++2a thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp
+
+HEADERS += \
+    ../stacks.h
@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stacks.h"
+
+// Global operator new/delete are replaced, so every allocation of containers is counted
+namespace alloc
+{
+    std::atomic<std::uint64_t> count {0};
+    std::atomic<std::uint64_t> bytes {0};
+
+    void * allocate(std::size_t size, std::size_t alignment = 0)
+    {
+        count.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+
+        void * p = nullptr;
+        if (alignment > alignof(std::max_align_t)) {
+            if (posix_memalign(&p, alignment, size ? size : 1) != 0)
+                p = nullptr;
+        } else
+            p = std::malloc(size ? size : 1);
+
+        if (!p)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    struct Snapshot
+    {
+        Snapshot() : count(alloc::count.load()), bytes(alloc::bytes.load()) {}
+
+        std::uint64_t count;
+        std::uint64_t bytes;
+    };
+}
+
+void * operator new(std::size_t size) { return alloc::allocate(size); }
+void * operator new[](std::size_t size) { return alloc::allocate(size); }
+void * operator new(std::size_t size, std::align_val_t a) { return alloc::allocate(size, std::size_t(a)); }
+void * operator new[](std::size_t size, std::align_val_t a) { return alloc::allocate(size, std::size_t(a)); }
+
+void operator delete(void * p) noexcept { std::free(p); }
+void operator delete[](void * p) noexcept { std::free(p); }
+void operator delete(void * p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void * p, std::size_t) noexcept { std::free(p); }
+void operator delete(void * p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void * p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void * p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void * p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+namespace bench
+{
+    // Results are summed here, so the compiler cannot throw the work away
+    std::atomic<long long> sink {0};
+
+    struct Benchmark
+    {
+        std::string name;
+        void (*run)(std::size_t n);
+    };
+
+    struct Result
+    {
+        std::string name;
+        std::size_t size;
+        double seconds;
+        std::uint64_t allocations;
+        std::uint64_t allocatedBytes;
+    };
+
+    void qstackPushPop(std::size_t n)
+    {
+        QStack<int> stack;
+        for (std::size_t i = 0; i < n; ++i)
+            stack.push(int(i));
+
+        long long sum = 0;
+        while (!stack.empty())
+            sum += stack.take();
+        sink += sum;
+    }
+
+    void compositePushPop(std::size_t n)
+    {
+        SoP::CompositeStack<int> stack(64);
+        for (std::size_t i = 0; i < n; ++i)
+            stack.push(int(i));
+
+        long long sum = 0;
+        while (!stack.empty())
+            sum += stack.take();
+        sink += sum;
+    }
+
+    void compositeTakeAt(std::size_t n)
+    {
+        SoP::CompositeStack<int> stack(64);
+        for (std::size_t i = 0; i < n; ++i)
+            stack.push(int(i));
+
+        std::mt19937 generator(50);
+        long long sum = 0;
+        for (std::size_t i = 0; i < n / 2; ++i) {
+            std::size_t index = generator() % stack.stacksCount();
+            sum += stack.takeAt(index);
+        }
+        sink += sum;
+    }
+
+    const std::size_t BATCH = 1024;
+
+    void queueAddTake(std::size_t n)
+    {
+        tsq::IntQueue queue;
+        long long sum = 0;
+        for (std::size_t i = 0; i < n; i += BATCH) {
+            const std::size_t count = std::min(BATCH, n - i);
+            for (std::size_t j = 0; j < count; ++j)
+                queue.add(int(j));
+            for (std::size_t j = 0; j < count; ++j)
+                sum += queue.take();
+        }
+        sink += sum;
+    }
+
+    void queueAddRangeDrain(std::size_t n)
+    {
+        tsq::IntQueue queue;
+        std::vector<int> input(BATCH), output(BATCH);
+        std::iota(input.begin(), input.end(), 0);
+
+        long long sum = 0;
+        for (std::size_t i = 0; i < n; i += BATCH) {
+            const std::size_t count = std::min(BATCH, n - i);
+            queue.addRange(input.begin(), input.begin() + count);
+            queue.drain(output.begin(), count);
+            sum += std::accumulate(output.begin(), output.begin() + count, 0LL);
+        }
+        sink += sum;
+    }
+
+    template <class Queue>
+    void producerConsumer(std::size_t n, int pairs)
+    {
+        Queue queue(1024);
+        std::vector<std::thread> threads;
+        for (int p = 0; p < pairs; ++p) {
+            threads.emplace_back([&] {
+                for (std::size_t i = 0; i < n / pairs; ++i)
+                    queue.add(int(i));
+            });
+            threads.emplace_back([&] {
+                long long sum = 0;
+                for (std::size_t i = 0; i < n / pairs; ++i)
+                    sum += queue.take();
+                sink += sum;
+            });
+        }
+        for (auto && t : threads)
+            t.join();
+    }
+
+    void spscProducerConsumer(std::size_t n) { producerConsumer<tsq::IntSpscQueue>(n, 1); }
+    void mpmcProducerConsumer(std::size_t n) { producerConsumer<tsq::IntMpmcQueue>(n, 2); }
+
+    std::vector<int> randomValues(std::size_t n)
+    {
+        std::mt19937 generator(50);
+        std::vector<int> values(n);
+        for (auto && v : values)
+            v = int(generator() % 1000000000);
+        return values;
+    }
+
+    void sortedPushTake(std::size_t n)
+    {
+        const std::vector<int> values = randomValues(n);
+
+        ss::IntStack stack;
+        for (auto && v : values)
+            stack.push(v);
+
+        long long sum = 0;
+        while (!stack.empty())
+            sum += stack.take();
+        sink += sum;
+    }
+
+    void sortedPushRangeTake(std::size_t n)
+    {
+        const std::vector<int> values = randomValues(n);
+
+        ss::IntStack stack;
+        stack.pushRange(values.begin(), values.end());
+
+        long long sum = 0;
+        while (!stack.empty())
+            sum += stack.take();
+        sink += sum;
+    }
+
+    void multiQueueEnqueueDequeue(std::size_t n)
+    {
+        const std::size_t categories = 8;
+        as::MultiQueue<int> queue(categories);
+        std::mt19937 generator(50);
+
+        long long sum = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            queue.enqueue(generator() % categories, int(i));
+            if (i % 2)
+                sum += queue.dequeueAny() + queue.dequeueWeighted();
+        }
+        while (!queue.empty())
+            sum += queue.dequeueAny();
+        sink += sum;
+    }
+
+    void animalQueueEnqueueDequeue(std::size_t n)
+    {
+        as::AnimalQueue queue;
+        std::mt19937 generator(50);
+
+        long long sum = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            queue.enqueue({"animal", generator() % 2 ? as::Animal::Dog : as::Animal::Cat});
+            if (i % 2)
+                sum += queue.dequeueAny().name.size();
+        }
+        for (std::size_t i = 0; i < n - n / 2; ++i)
+            sum += queue.dequeueAny().name.size();
+        sink += sum;
+    }
+
+    const std::vector<Benchmark> & benchmarks()
+    {
+        static const std::vector<Benchmark> all {
+            {"QStack/pushPop", qstackPushPop},
+            {"CompositeStack/pushPop", compositePushPop},
+            {"CompositeStack/randomTakeAt", compositeTakeAt},
+            {"Queue/addTake", queueAddTake},
+            {"Queue/addRangeDrain", queueAddRangeDrain},
+            {"SpscQueue/producerConsumer", spscProducerConsumer},
+            {"MpmcQueue/producerConsumer", mpmcProducerConsumer},
+            {"SortedStack/pushTake", sortedPushTake},
+            {"SortedStack/pushRangeTake", sortedPushRangeTake},
+            {"MultiQueue/enqueueDequeue", multiQueueEnqueueDequeue},
+            {"AnimalQueue/enqueueDequeue", animalQueueEnqueueDequeue},
+        };
+        return all;
+    }
+
+    /// The best time of several runs; allocations are the same in every run
+    Result measure(Benchmark const& benchmark, std::size_t n, int repeat)
+    {
+        Result result {benchmark.name, n, 0, 0, 0};
+        for (int r = 0; r < repeat; ++r) {
+            alloc::Snapshot before;
+            auto start = std::chrono::steady_clock::now();
+            benchmark.run(n);
+            auto stop = std::chrono::steady_clock::now();
+            alloc::Snapshot after;
+
+            double seconds = std::chrono::duration<double>(stop - start).count();
+            if (r == 0 || seconds < result.seconds)
+                result.seconds = seconds;
+            result.allocations = after.count - before.count;
+            result.allocatedBytes = after.bytes - before.bytes;
+        }
+        return result;
+    }
+
+    std::string toJson(std::vector<Result> const& results)
+    {
+        std::ostringstream out;
+        out.precision(9);
+        out << "{\n  \"results\": [";
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            auto && r = results[i];
+            out << (i ? ",\n" : "\n")
+                << "    {\"name\": \"" << r.name << "\", \"size\": " << r.size
+                << ", \"seconds\": " << r.seconds
+                << ", \"itemsPerSecond\": " << (r.seconds > 0 ? r.size / r.seconds : 0)
+                << ", \"allocations\": " << r.allocations
+                << ", \"allocatedBytes\": " << r.allocatedBytes << "}";
+        }
+        out << "\n  ]\n}\n";
+        return out.str();
+    }
+
+    /// Non-negative number, stoull would silently wrap "-1" around
+    std::size_t parseCount(std::string const& value)
+    {
+        std::size_t end = 0;
+        if (value.empty() || value[0] == '-')
+            throw std::invalid_argument("Negative or empty number: " + value);
+        std::size_t count = std::stoull(value, &end);
+        if (end != value.size())
+            throw std::invalid_argument("Not a number: " + value);
+        return count;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::size_t minSize = 1000;
+    std::size_t maxSize = 1000000;
+    int repeat = 3;
+    std::string filter;
+    std::string outPath;
+
+    auto usage = [&] {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--min-size N] [--max-size N] [--repeat N] [--filter NAME] [--out FILE]" << std::endl;
+        return 1;
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            return usage();
+
+        std::string value = argv[++i];
+        try {
+            if (arg == "--min-size")
+                minSize = bench::parseCount(value);
+            else if (arg == "--max-size")
+                maxSize = bench::parseCount(value);
+            else if (arg == "--repeat")
+                repeat = int(std::clamp<std::size_t>(bench::parseCount(value), 1, std::numeric_limits<int>::max()));
+            else if (arg == "--filter")
+                filter = value;
+            else if (arg == "--out")
+                outPath = value;
+            else {
+                std::cerr << "Unknown option " << arg << std::endl;
+                return usage();
+            }
+        } catch (std::exception const& e) {
+            std::cerr << "Invalid value " << value << " of " << arg << std::endl;
+            return usage();
+        }
+    }
+
+    // Sizes grow ten times per step, zero would never grow
+    if (minSize == 0) {
+        std::cerr << "Minimal size must be positive." << std::endl;
+        return 1;
+    }
+
+    std::vector<bench::Result> results;
+    for (auto && benchmark : bench::benchmarks()) {
+        if (!filter.empty() && benchmark.name.find(filter) == std::string::npos)
+            continue;
+
+        for (std::size_t n = minSize; n <= maxSize; n *= 10) {
+            results.push_back(bench::measure(benchmark, n, repeat));
+            std::cerr << benchmark.name << "\t" << n << "\t" << results.back().seconds << " s" << std::endl;
+
+            // The next size would overflow
+            if (n > maxSize / 10)
+                break;
+        }
+    }
+
+    const std::string json = bench::toJson(results);
+    if (outPath.empty())
+        std::cout << json;
+    else
+        std::ofstream(outPath) << json;
+
+    return 0;
+}
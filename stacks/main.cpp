@@ -1,271 +1,11 @@
+#include <chrono>
 #include <iostream>
-#include <stack>
+#include <numeric>
+#include <random>
+#include <string>
 #include <vector>
-#include <list>
 
-#include <boost/range/algorithm_ext/erase.hpp>
-
-template <class T>
-class QStack : public std::stack<T>
-{
-  public:
-    T take() {
-        T v = this->top();
-        this->pop();
-        return v;
-    }
-
-    T takeBottom() {
-        T v = this->c.front();
-        this->c.pop_front();
-        return v;
-    }
-
-    void print() const
-    {
-        for (auto && v : this->c)
-            std::cout << v << "\t";
-        std::cout << std::endl;
-    }
-};
-
-// Stack of Plates. Composite stack behaves as usual stack
-namespace SoP
-{
-    template <class T>
-    class CompositeStack
-    {
-    public:
-        void push(T const& t)
-        {
-            if (m_stacks.empty() || m_stacks.back().size() == capacity())
-                m_stacks.emplace_back(QStack<T>());
-
-            m_stacks.back().push(t);
-        }
-
-        T take()
-        {
-            if (empty())
-                throw std::logic_error("The compoiste stack is empty.");
-
-            auto &&back = m_stacks.back();
-            T v = back.take();
-            if (back.empty())
-                m_stacks.erase(--std::end(m_stacks));
-            return v;
-        }
-
-        T takeAt(std::size_t index)
-        {
-            if (index >= m_stacks.size())
-                throw std::logic_error("Cannot take from this stack.");
-
-            return leftShift(index, true /*removeTop*/);
-        }
-
-        bool empty() const { return m_stacks.empty(); }
-
-        static std::size_t capacity() { return 3; }
-
-    private:
-        T leftShift(std::size_t index, bool removeTop)
-        {
-            auto &&stack = m_stacks.at(index);
-            T removedItem = removeTop ? stack.take() : stack.takeBottom();
-            if (stack.empty())
-                boost::range::remove_erase(m_stacks, stack);
-            else if (m_stacks.size() > index + 1)  {// not last element
-                T v = leftShift(index + 1, false /*remove top*/);
-                stack.push(v);
-            }
-
-            return removedItem;
-        }
-
-        std::vector<QStack<T>> m_stacks;
-    };
-
-    using IntCompositeStack = CompositeStack<int>;
-}
-
-// Implement Queue via two stacks
-namespace tsq
-{
-    template <class T>
-    class Queue
-    {
-    public:
-        std::size_t size() const { return m_oldest.size() + m_newest.size(); }
-
-        void add(T const& e)
-        {
-            // Newest stack always has new element on top
-            m_newest.push(e);
-        }
-
-
-        T & peek() { return const_cast<T&>(const_cast<Queue<T> *>(this)->peek()); }
-        T const& peek() const
-        {
-            shiftStacks();
-            return m_oldest.top();
-        }
-
-        T take()
-        {
-            shiftStacks();
-            return m_oldest.take();
-        }
-
-    private:
-        /// Moves elements from newest stack to oldest
-        void shiftStacks() const
-        {
-            if (m_oldest.empty())
-                while (!m_newest.empty())
-                    m_oldest.push(m_newest.take());
-        }
-
-        mutable QStack<T> m_oldest;
-        mutable QStack<T> m_newest;
-    };
-
-    using IntQueue = Queue<int>;
-}
-
-// Implement sorted stack with using two stacks
-namespace ss
-{
-    template <class T>
-    class SortedStack
-    {
-    public:
-        T const & peek() const { return m_stack.pop(); }
-        T  & peek() { return m_stack.top(); }
-
-        T take() { return m_stack.take(); }
-
-        void push(T const& v)
-        {
-            m_stack.push(v);
-            sort();
-        }
-
-        bool empty() const { return m_stack.empty(); }
-
-    private:
-        void sort()
-        {
-            QStack<T> tmpStask;
-            while (!m_stack.empty()) {
-
-                // Insert each element to the s in the sorted order
-                int tmpVal = m_stack.take();
-                while (!tmpStask.empty() && tmpStask.top() > tmpVal)
-                    m_stack.push(tmpStask.take());
-
-                tmpStask.push(tmpVal);
-
-                std::cout << "stask: ";
-                m_stack.print();
-                std::cout << "tmp: ";
-                tmpStask.print();
-            }
-
-            // Copy elements back
-            while (!tmpStask.empty())
-                m_stack.push(tmpStask.take());
-        }
-
-        QStack<T> m_stack;
-    };
-
-    using IntStack = SortedStack<int>;
-}
-
-// Animal shelter. Implement functions to "adopt" the oldest animal (in general) or perticulat animal
-// (i.e. dog or cat).
-namespace as
-{
-    struct Animal
-    {
-        std::string name;
-
-        // Easy one, we don't have any behavioural difference between dogs and cats in this model
-        enum Type { Dog, Cat };
-        Type type;
-    };
-
-    class AnimalQueue
-    {
-    public:
-        void enqueue(Animal const& animal)
-        {
-            if (animal.type == Animal::Dog)
-                m_dogs.push_back({s_animalCounter++,animal});
-            else
-                m_cats.push_back({s_animalCounter++,animal});
-        }
-
-        Animal dequeueAny()
-        {
-            if (m_dogs.empty())
-                return dequeueCat();
-
-            if (m_cats.empty())
-                return dequeueDog();
-
-            OrderedAnimal dog = m_dogs.back();
-            OrderedAnimal cat = m_cats.back();
-            if (dog.first > cat.first) {
-                m_dogs.pop_back();
-                return dog.second;
-            } else {
-                m_cats.pop_back();
-                return cat.second;
-            }
-        }
-
-        Animal dequeueDog()
-        {
-            return dequeueImpl(m_dogs);
-        }
-
-        Animal dequeueCat()
-        {
-            return dequeueImpl(m_cats);
-        }
-
-    private:
-        using OrderedAnimal = std::pair<std::size_t, Animal>;
-        using AnimalsList = std::list<OrderedAnimal>;
-
-        Animal dequeueImpl(AnimalsList & animals)
-        {
-            if (animals.empty())
-                throw std::logic_error("No animals of this type or at all.");
-
-            OrderedAnimal animal = animals.back();
-            animals.pop_back();
-            return animal.second;
-        }
-
-        static std::size_t s_animalCounter;
-
-        AnimalsList m_dogs;
-        AnimalsList m_cats;
-    };
-
-    std::size_t AnimalQueue::s_animalCounter = 0;
-
-    void print(Animal const& animal)
-    {
-        std::cout << animal.name
-                  << "\t"
-                  << (animal.type == Animal::Dog ? "dog" : "cat") << std::endl;
-    }
-}
+#include "stacks.h"
 
 int main(int /*argc*/, char */*argv*/[])
 {
@@ -300,18 +40,353 @@ int main(int /*argc*/, char */*argv*/[])
 //        std::cout << s.take() << std::endl;
 
     // 4
-    as::AnimalQueue queue;
-    queue.enqueue({"a1", as::Animal::Dog});
-    queue.enqueue({"a2", as::Animal::Cat});
-    queue.enqueue({"a3", as::Animal::Dog});
-    queue.enqueue({"a4", as::Animal::Dog});
-    queue.enqueue({"a5", as::Animal::Cat});
-
+//    as::AnimalQueue queue;
+//    queue.enqueue({"a1", as::Animal::Dog});
+//    queue.enqueue({"a2", as::Animal::Cat});
+//    queue.enqueue({"a3", as::Animal::Dog});
+//    queue.enqueue({"a4", as::Animal::Dog});
+//    queue.enqueue({"a5", as::Animal::Cat});
+
+//    try {
+//        as::print(queue.dequeueAny());
+//        as::print(queue.dequeueDog());
+//        as::print(queue.dequeueCat());
+//        as::print(queue.dequeueCat());
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 5
+//    // Random takeAt on a big composite stack
+//    try {
+//        const std::size_t count = 1000000;
+//        SoP::CompositeStack<int> stack(64);
+//        for (std::size_t i = 0; i < count; ++i)
+//            stack.push(int(i));
+
+//        std::mt19937 generator(5);
+//        auto start = std::chrono::steady_clock::now();
+//        long long sum = 0;
+//        for (std::size_t i = 0; i < count / 2; ++i) {
+//            std::size_t index = generator() % stack.stacksCount();
+//            sum += stack.takeAt(index);
+//        }
+//        auto stop = std::chrono::steady_clock::now();
+
+//        std::cout << "Taken " << count / 2 << " elements, sum: " << sum << ", substacks: " << stack.stacksCount()
+//                  << ", time: " << std::chrono::duration<double, std::milli>(stop - start).count() << " ms" << std::endl;
+
+//        while (!stack.empty())
+//            sum += stack.take();
+//        std::cout << "Sum of all elements: " << sum << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 6
+//    // Producers and consumers: two-stack queue under a mutex vs. ring buffers
+//    try {
+//        const int count = 1000000;
+
+//        auto run = [&](std::string const& name, int pairs, auto && add, auto && take) {
+//            auto start = std::chrono::steady_clock::now();
+//            std::vector<std::thread> threads;
+//            std::atomic<long long> sum {0};
+//            for (int p = 0; p < pairs; ++p) {
+//                threads.emplace_back([&] { for (int i = 0; i < count / pairs; ++i) add(i); });
+//                threads.emplace_back([&] {
+//                    long long local = 0;
+//                    for (int i = 0; i < count / pairs; ++i)
+//                        local += take();
+//                    sum += local;
+//                });
+//            }
+//            for (auto && t : threads)
+//                t.join();
+//            auto stop = std::chrono::steady_clock::now();
+
+//            double seconds = std::chrono::duration<double>(stop - start).count();
+//            std::cout << name << "\tpairs: " << pairs << "\tsum: " << sum << "\t"
+//                      << count / seconds / 1e6 << " Mops/s" << std::endl;
+//        };
+
+//        for (int pairs = 1; pairs <= 8; pairs *= 2) {
+//            std::mutex mutex;
+//            tsq::IntQueue queue;
+//            run("Locked two-stack", pairs,
+//                [&](int v) { std::lock_guard<std::mutex> l(mutex); queue.add(v); },
+//                [&] {
+//                    while (true) {
+//                        {
+//                            std::lock_guard<std::mutex> l(mutex);
+//                            if (queue.size() != 0)
+//                                return queue.take();
+//                        }
+//                        std::this_thread::yield();
+//                    }
+//                });
+
+//            tsq::IntMpmcQueue mpmc(1024);
+//            run("MPMC ring", pairs, [&](int v) { mpmc.add(v); }, [&] { return mpmc.take(); });
+
+//            if (pairs == 1) {
+//                tsq::IntSpscQueue spsc(1024);
+//                run("SPSC ring", pairs, [&](int v) { spsc.add(v); }, [&] { return spsc.take(); });
+//            }
+//        }
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 7
+//    // Sorted stack on hot path: pushes one by one and in bulk
+//    try {
+//        const int count = 1000000;
+//        std::mt19937 generator(7);
+//        std::vector<int> values(count);
+//        for (auto && v : values)
+//            v = int(generator() % 1000000);
+
+//        ss::IntStack one, bulk;
+//        auto start = std::chrono::steady_clock::now();
+//        for (auto && v : values)
+//            one.push(v);
+//        auto middle = std::chrono::steady_clock::now();
+//        bulk.pushRange(values.begin(), values.end());
+//        auto stop = std::chrono::steady_clock::now();
+
+//        std::cout << "Push: " << std::chrono::duration<double, std::milli>(middle - start).count() << " ms, "
+//                  << "pushRange: " << std::chrono::duration<double, std::milli>(stop - middle).count() << " ms" << std::endl;
+
+//        bool sorted = true;
+//        for (int previous = -1; !one.empty(); ) {
+//            int v = one.take();
+//            sorted = sorted && v >= previous && v == bulk.take();
+//            previous = v;
+//        }
+//        std::cout << "Sorted: " << std::boolalpha << sorted << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 8
+//    // Shelter is the oldest first now; throughput of many categories
+//    try {
+//        as::AnimalQueue queue;
+//        queue.enqueue({"a1", as::Animal::Dog});
+//        queue.enqueue({"a2", as::Animal::Cat});
+//        queue.enqueue({"a3", as::Animal::Dog});
+//        as::print(queue.dequeueAny());
+//        as::print(queue.dequeueAny());
+
+//        const std::size_t categories = 8;
+//        const int count = 20000000;
+//        as::MultiQueue<int> multiQueue(categories);
+//        for (std::size_t c = 0; c < categories; ++c)
+//            multiQueue.setWeight(c, c + 1);
+
+//        std::mt19937 generator(8);
+//        long long sum = 0;
+//        auto start = std::chrono::steady_clock::now();
+//        for (int i = 0; i < count; ++i) {
+//            multiQueue.enqueue(generator() % categories, i);
+//            if (i % 4 == 3) {
+//                for (int j = 0; j < 4; ++j)
+//                    sum += j % 2 ? multiQueue.dequeueAny() : multiQueue.dequeueWeighted();
+//            }
+//        }
+//        auto stop = std::chrono::steady_clock::now();
+
+//        double seconds = std::chrono::duration<double>(stop - start).count();
+//        std::cout << "Sum: " << sum << ", " << 2 * count / seconds / 1e6 << " Mops/s" << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 9
+//    // Contention: composite stack under a mutex vs. concurrent one, push and take in pairs
+//    try {
+//        const int count = 2000000;
+
+//        auto run = [&](std::string const& name, int threads, auto && push, auto && take) {
+//            auto start = std::chrono::steady_clock::now();
+//            std::vector<std::thread> workers;
+//            for (int t = 0; t < threads; ++t) {
+//                workers.emplace_back([&] {
+//                    for (int i = 0; i < count / threads / 2; ++i) {
+//                        push(i);
+//                        take();
+//                    }
+//                });
+//            }
+//            for (auto && w : workers)
+//                w.join();
+//            auto stop = std::chrono::steady_clock::now();
+
+//            double seconds = std::chrono::duration<double>(stop - start).count();
+//            std::cout << name << "\tthreads: " << threads << "\t" << count / seconds / 1e6 << " Mops/s" << std::endl;
+//        };
+
+//        for (int threads = 1; threads <= 64; threads *= 2) {
+//            std::mutex mutex;
+//            SoP::IntCompositeStack locked(64);
+//            run("Locked composite", threads,
+//                [&](int v) { std::lock_guard<std::mutex> l(mutex); locked.push(v); },
+//                [&] { std::lock_guard<std::mutex> l(mutex); return locked.empty() ? 0 : locked.take(); });
+
+//            SoP::IntConcurrentCompositeStack concurrent(64);
+//            run("Concurrent composite", threads,
+//                [&](int v) { concurrent.push(v); },
+//                [&] { int v = 0; concurrent.tryTake(v); return v; });
+//        }
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 10
+//    // Strings are moved in and out; per request memory comes from one monotonic buffer
+//    try {
+//        const int count = 1000000;
+//        const std::string payload(64, 'x');
+
+//        auto start = std::chrono::steady_clock::now();
+//        {
+//            SoP::CompositeStack<std::string> stack(64);
+//            for (int i = 0; i < count; ++i)
+//                stack.emplace(payload);
+//            while (!stack.empty())
+//                stack.take();
+//        }
+//        auto middle = std::chrono::steady_clock::now();
+//        {
+//            std::pmr::monotonic_buffer_resource resource;
+//            SoP::PmrCompositeStack<std::pmr::string> stack(64, &resource);
+//            for (int i = 0; i < count; ++i)
+//                stack.emplace(payload);
+//            while (!stack.empty())
+//                stack.take();
+//        }
+//        auto stop = std::chrono::steady_clock::now();
+
+//        std::cout << "Default allocator: " << std::chrono::duration<double, std::milli>(middle - start).count() << " ms, "
+//                  << "monotonic resource: " << std::chrono::duration<double, std::milli>(stop - middle).count() << " ms" << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 11
+//    // Min and max over a sliding window: scan of the window vs. aggregate queue
+//    try {
+//        const int count = 1000000;
+//        const std::size_t window = 1000;
+
+//        std::mt19937 generator(11);
+//        std::vector<int> events(count);
+//        for (auto && e : events)
+//            e = int(generator() % 1000000);
+
+//        long long scanSum = 0;
+//        auto start = std::chrono::steady_clock::now();
+//        {
+//            tsq::IntQueue queue;
+//            std::deque<int> copy;
+//            for (auto && e : events) {
+//                queue.add(e);
+//                copy.push_back(e);
+//                if (queue.size() > window) {
+//                    queue.take();
+//                    copy.pop_front();
+//                }
+//                auto minMax = std::minmax_element(copy.begin(), copy.end());
+//                scanSum += *minMax.second - *minMax.first;
+//            }
+//        }
+//        auto middle = std::chrono::steady_clock::now();
+
+//        long long aggregateSum = 0;
+//        {
+//            ag::IntMinMaxQueue queue;
+//            for (auto && e : events) {
+//                queue.add(e);
+//                if (queue.size() > window)
+//                    queue.take();
+//                auto minMax = queue.aggregate();
+//                aggregateSum += minMax.second - minMax.first;
+//            }
+//        }
+//        auto stop = std::chrono::steady_clock::now();
+
+//        std::cout << "Same results: " << std::boolalpha << (scanSum == aggregateSum) << std::endl;
+//        std::cout << "Scan: " << std::chrono::duration<double, std::milli>(middle - start).count() << " ms, "
+//                  << "aggregate queue: " << std::chrono::duration<double, std::milli>(stop - middle).count() << " ms" << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 12
+//    // Consumers work in batches: element by element vs. addRange/drain
+//    try {
+//        const int count = 10000000;
+//        const std::size_t batch = 1024;
+
+//        std::vector<int> input(batch), output(batch);
+//        std::iota(input.begin(), input.end(), 0);
+
+//        long long singleSum = 0, batchSum = 0;
+//        auto start = std::chrono::steady_clock::now();
+//        {
+//            tsq::IntQueue queue;
+//            for (int i = 0; i < count; i += int(batch)) {
+//                for (auto && v : input)
+//                    queue.add(v);
+//                for (std::size_t j = 0; j < batch; ++j)
+//                    output[j] = queue.take();
+//                singleSum += std::accumulate(output.begin(), output.end(), 0LL);
+//            }
+//        }
+//        auto middle = std::chrono::steady_clock::now();
+//        {
+//            tsq::IntQueue queue;
+//            for (int i = 0; i < count; i += int(batch)) {
+//                queue.addRange(input.begin(), input.end());
+//                queue.drain(output.begin(), batch);
+//                batchSum += std::accumulate(output.begin(), output.end(), 0LL);
+//            }
+//        }
+//        auto stop = std::chrono::steady_clock::now();
+
+//        std::cout << "Same results: " << std::boolalpha << (singleSum == batchSum) << std::endl;
+//        std::cout << "Element by element: " << std::chrono::duration<double, std::milli>(middle - start).count() << " ms, "
+//                  << "batches: " << std::chrono::duration<double, std::milli>(stop - middle).count() << " ms" << std::endl;
+//    } catch (std::exception const& e) {
+//        std::cout << e.what() << std::endl;
+//    }
+
+    // 13
+    // Fast producer and slow consumer on a bounded queue, producer waits instead of polling
     try {
-        as::print(queue.dequeueAny());
-        as::print(queue.dequeueDog());
-        as::print(queue.dequeueCat());
-        as::print(queue.dequeueCat());
+        aq::Executor executor;
+        aq::BoundedQueue<int> queue(executor, 4);
+        std::size_t maxSize = 0;
+
+        auto producer = [&]() -> aq::Task {
+            for (int i = 0; i < 10; ++i) {
+                co_await queue.add(i);
+                maxSize = std::max(maxSize, queue.size());
+            }
+            co_await queue.add(-1);
+        };
+
+        auto consumer = [&]() -> aq::Task {
+            for (int v = co_await queue.take(); v != -1; v = co_await queue.take())
+                std::cout << v << " ";
+            std::cout << std::endl;
+        };
+
+        executor.spawn(consumer());
+        executor.spawn(producer());
+        bool done = executor.run();
+        std::cout << "All done: " << std::boolalpha << done << ", max size: " << maxSize << std::endl;
     } catch (std::exception const& e) {
         std::cout << e.what() << std::endl;
     }
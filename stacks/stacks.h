@@ -0,0 +1,1647 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <shared_mutex>
+#include <stack>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+static const std::size_t CACHE_LINE_SIZE = 64;
+
+template <class T, class Container = std::deque<T>>
+class QStack : public std::stack<T, Container>
+{
+  public:
+    using std::stack<T, Container>::stack;
+
+    T take() {
+        T v = std::move(this->top());
+        this->pop();
+        return v;
+    }
+
+    T takeBottom() {
+        T v = std::move(this->c.front());
+        this->c.pop_front();
+        return v;
+    }
+
+    /// Pushes the range, the last element is on top
+    template <class It>
+    void pushRange(It first, It last) { this->c.insert(this->c.end(), first, last); }
+
+    /// Moves up to count elements from the top, top first, with one erase of the container
+    template <class OutIt>
+    std::size_t takeRange(std::size_t count, OutIt & out)
+    {
+        count = std::min(count, this->c.size());
+        auto first = this->c.end() - count;
+        out = std::move(std::make_reverse_iterator(this->c.end()), std::make_reverse_iterator(first), out);
+        this->c.erase(first, this->c.end());
+        return count;
+    }
+
+    /// Top becomes the bottom
+    void reverse() { std::reverse(this->c.begin(), this->c.end()); }
+
+    void print() const
+    {
+        for (auto && v : this->c)
+            std::cout << v << "\t";
+        std::cout << std::endl;
+    }
+};
+
+template <class T>
+using PmrQStack = QStack<T, std::pmr::deque<T>>;
+
+// Stack of Plates. Composite stack behaves as usual stack
+namespace SoP
+{
+    /// Free list of fixed-size chunks of raw storage, so substacks are not allocated again and again.
+    /// Chunks are allocated by the allocator, so the same memory resource serves all of them.
+    template <class T, class Allocator = std::allocator<T>>
+    class ChunkPool
+    {
+        using Traits = std::allocator_traits<Allocator>;
+        using ChunkAllocator = typename Traits::template rebind_alloc<typename Traits::pointer>;
+
+    public:
+        using ChunkPtr = typename Traits::pointer;
+
+        explicit ChunkPool(std::size_t chunkSize, Allocator const& allocator = Allocator())
+            : m_chunkSize(chunkSize)
+            , m_allocator(allocator)
+            , m_free(ChunkAllocator(allocator))
+        {}
+
+        ChunkPool(ChunkPool &&) noexcept = default;
+
+        /// Chunks of the other pool are taken over, so the allocators must be equal unless the
+        /// allocator propagates on move assignment
+        ChunkPool &operator =(ChunkPool && other) noexcept
+        {
+            if (this == &other)
+                return *this;
+
+            clear();
+            if constexpr (Traits::propagate_on_container_move_assignment::value)
+                m_allocator = std::move(other.m_allocator);
+            m_chunkSize = other.m_chunkSize;
+            m_free = std::move(other.m_free);
+            other.m_free.clear();
+            return *this;
+        }
+
+        ~ChunkPool() { clear(); }
+
+        std::size_t chunkSize() const { return m_chunkSize; }
+        Allocator & allocator() { return m_allocator; }
+        Allocator const& allocator() const { return m_allocator; }
+
+        ChunkPtr acquire()
+        {
+            if (m_free.empty())
+                return Traits::allocate(m_allocator, m_chunkSize);
+
+            ChunkPtr chunk = m_free.back();
+            m_free.pop_back();
+            return chunk;
+        }
+
+        void release(ChunkPtr chunk) { m_free.push_back(chunk); }
+
+    private:
+        void clear()
+        {
+            for (auto && chunk : m_free)
+                Traits::deallocate(m_allocator, chunk, m_chunkSize);
+            m_free.clear();
+        }
+
+        std::size_t m_chunkSize;
+        Allocator m_allocator;
+        std::vector<ChunkPtr, ChunkAllocator> m_free;
+    };
+
+    /// Substacks are contiguous chunks of the given capacity. takeAt doesn't shift elements of the
+    /// next substacks, so substacks in the middle may be partially filled or even empty. They are
+    /// compacted when there are twice as many substacks as needed, it renumbers substacks.
+    template <class T, class Allocator = std::allocator<T>>
+    class CompositeStack
+    {
+        using Traits = std::allocator_traits<Allocator>;
+
+    public:
+        static const std::size_t DEFAULT_CAPACITY = 3;
+
+        explicit CompositeStack(std::size_t capacity = DEFAULT_CAPACITY, Allocator const& allocator = Allocator())
+            : m_pool(capacity, allocator)
+            , m_chunks(typename Traits::template rebind_alloc<Chunk>(allocator))
+        {
+            if (capacity == 0)
+                throw std::invalid_argument("Capacity of a substack must be positive.");
+        }
+
+        CompositeStack(CompositeStack const& other)
+            : CompositeStack(other, Traits::select_on_container_copy_construction(other.m_pool.allocator()))
+        {}
+
+        /// Copies keep the substacks as they are, even the ones emptied by takeAt
+        CompositeStack(CompositeStack const& other, Allocator const& allocator)
+            : CompositeStack(other.capacity(), allocator)
+        {
+            // The destructor cleans up if a copy throws, since the delegated constructor has finished
+            m_chunks.reserve(other.m_chunks.size());
+            for (auto && chunk : other.m_chunks) {
+                m_chunks.push_back({m_pool.acquire(), 0});
+                auto &&copy = m_chunks.back();
+                for (; copy.size < chunk.size; ++copy.size)
+                    Traits::construct(m_pool.allocator(), &copy.data[copy.size], chunk.data[copy.size]);
+                m_size += chunk.size;
+            }
+        }
+
+        CompositeStack(CompositeStack && other) noexcept
+            : m_pool(std::move(other.m_pool))
+            , m_chunks(std::move(other.m_chunks))
+            , m_size(std::exchange(other.m_size, 0))
+        {
+            other.m_chunks.clear();
+        }
+
+        CompositeStack &operator =(CompositeStack && other) noexcept
+        {
+            if (this == &other)
+                return *this;
+
+            clear();
+            m_pool = std::move(other.m_pool);
+            m_chunks = std::move(other.m_chunks);
+            m_size = std::exchange(other.m_size, 0);
+            other.m_chunks.clear();
+            return *this;
+        }
+
+        CompositeStack &operator =(CompositeStack const& other)
+        {
+            if (this != &other) {
+                *this = CompositeStack(other, Traits::propagate_on_container_copy_assignment::value
+                                              ? other.m_pool.allocator() : m_pool.allocator());
+            }
+            return *this;
+        }
+
+        ~CompositeStack() { clear(); }
+
+        void push(T const& t) { emplace(t); }
+        void push(T && t) { emplace(std::move(t)); }
+
+        template <class... Args>
+        T & emplace(Args &&... args)
+        {
+            if (m_chunks.empty() || m_chunks.back().size == capacity())
+                m_chunks.push_back({m_pool.acquire(), 0});
+
+            auto &&back = m_chunks.back();
+            Traits::construct(m_pool.allocator(), &back.data[back.size], std::forward<Args>(args)...);
+            ++back.size;
+            ++m_size;
+            return back.data[back.size - 1];
+        }
+
+        T take()
+        {
+            if (empty())
+                throw std::logic_error("The compoiste stack is empty.");
+
+            T v = takeTop(m_chunks.back());
+            releaseEmptyBack();
+            return v;
+        }
+
+        /// Takes the top of the substack for any index below stacksCount(). If takeAt has emptied
+        /// the substack, the top of the nearest non-empty substack above it is taken, as the
+        /// elements would be shifted down in a compacted stack. The last substack is never empty.
+        T takeAt(std::size_t index)
+        {
+            if (index >= m_chunks.size())
+                throw std::logic_error("Cannot take from this stack.");
+
+            while (m_chunks[index].size == 0)
+                ++index;
+
+            T v = takeTop(m_chunks[index]);
+            if (index + 1 == m_chunks.size())
+                releaseEmptyBack();
+            else if (m_chunks.size() > 2 * (m_size / capacity() + 1))
+                compact();
+
+            return v;
+        }
+
+        /// Moves all elements to the beginning, so all substacks except the last one are full
+        void compact()
+        {
+            std::size_t w = 0, j = 0;
+            for (std::size_t r = 0; r < m_chunks.size(); ++r) {
+                for (std::size_t i = 0; i < m_chunks[r].size; ++i) {
+                    if (r != w || i != j) {
+                        Traits::construct(m_pool.allocator(), &m_chunks[w].data[j], std::move(m_chunks[r].data[i]));
+                        destroy(m_chunks[r], i);
+                    }
+
+                    if (++j == capacity()) {
+                        m_chunks[w].size = j;
+                        ++w;
+                        j = 0;
+                    }
+                }
+            }
+
+            if (j != 0)
+                m_chunks[w++].size = j;
+            while (m_chunks.size() > w)
+                releaseBack();
+        }
+
+        bool empty() const { return m_size == 0; }
+        std::size_t size() const { return m_size; }
+
+        std::size_t stacksCount() const { return m_chunks.size(); }
+        std::size_t stackSize(std::size_t index) const { return m_chunks.at(index).size; }
+
+        std::size_t capacity() const { return m_pool.chunkSize(); }
+
+    private:
+        struct Chunk
+        {
+            typename ChunkPool<T, Allocator>::ChunkPtr data;
+            std::size_t size;
+        };
+
+        void destroy(Chunk & chunk, std::size_t i) { Traits::destroy(m_pool.allocator(), &chunk.data[i]); }
+
+        /// Destroys all elements and returns their chunks to the pool
+        void clear()
+        {
+            for (auto && chunk : m_chunks) {
+                for (std::size_t i = 0; i < chunk.size; ++i)
+                    destroy(chunk, i);
+                m_pool.release(chunk.data);
+            }
+            m_chunks.clear();
+            m_size = 0;
+        }
+
+        T takeTop(Chunk & chunk)
+        {
+            T v = std::move(chunk.data[chunk.size - 1]);
+            destroy(chunk, --chunk.size);
+            --m_size;
+            return v;
+        }
+
+        void releaseBack()
+        {
+            m_pool.release(m_chunks.back().data);
+            m_chunks.pop_back();
+        }
+
+        /// Substacks below the last one may be emptied by takeAt
+        void releaseEmptyBack()
+        {
+            while (!m_chunks.empty() && m_chunks.back().size == 0)
+                releaseBack();
+        }
+
+        ChunkPool<T, Allocator> m_pool;
+        std::vector<Chunk, typename Traits::template rebind_alloc<Chunk>> m_chunks;
+        std::size_t m_size = 0;
+    };
+
+    using IntCompositeStack = CompositeStack<int>;
+
+    template <class T>
+    using PmrCompositeStack = CompositeStack<T, std::pmr::polymorphic_allocator<T>>;
+
+    /// Composite stack for many threads. The newest elements are in a lock-free (Treiber) stack. A
+    /// thread which loses the race for its top goes to the elimination array, where a push and a
+    /// take can meet and cancel each other without touching the top at all. When the top grows to
+    /// the capacity, it is detached at once and becomes a substack with own lock: take falls back
+    /// to substacks when the top is empty, takeAt works on them only.
+    template <class T>
+    class ConcurrentCompositeStack
+    {
+        using Index = std::uint32_t;
+        using Tagged = std::uint64_t; // Counter of changes and index, counter excludes ABA
+
+        struct Node
+        {
+            std::atomic<Index> next;
+            std::atomic<std::uint32_t> depth;
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+            T & value() { return reinterpret_cast<T &>(storage); }
+        };
+
+        struct Substack
+        {
+            std::mutex mutex;
+            std::vector<T> items;
+        };
+
+        struct alignas(CACHE_LINE_SIZE) Slot
+        {
+            std::atomic<std::uint64_t> value {EMPTY};
+        };
+
+        static const Index NIL = ~Index(0);
+
+        // Nodes are never released until destruction, segment s has FIRST_SEGMENT << s nodes
+        static const int SEGMENTS_COUNT = 22;
+        static const std::uint64_t FIRST_SEGMENT = 1024;
+
+        // Elimination slot is empty, has a node of a waiting push or is taken by a take
+        static const std::uint64_t EMPTY = 0;
+        static const std::uint64_t WAITING = std::uint64_t(1) << 62;
+        static const std::uint64_t TAKEN = std::uint64_t(2) << 62;
+        static const int ELIMINATION_SPINS = 128;
+
+    public:
+        static const std::size_t DEFAULT_CAPACITY = 64;
+        static const std::size_t ELIMINATION_SIZE = 8;
+
+        explicit ConcurrentCompositeStack(std::size_t capacity = DEFAULT_CAPACITY)
+            : m_capacity(capacity)
+        {
+            if (capacity == 0)
+                throw std::invalid_argument("Capacity of a substack must be positive.");
+
+            for (auto && s : m_segments)
+                s.store(nullptr, std::memory_order_relaxed);
+        }
+
+        ~ConcurrentCompositeStack()
+        {
+            for (Index i = index(m_top.load()); i != NIL; i = node(i).next.load())
+                node(i).value().~T();
+
+            for (auto && s : m_segments)
+                delete [] s.load();
+        }
+
+        ConcurrentCompositeStack(ConcurrentCompositeStack const&) = delete;
+        ConcurrentCompositeStack &operator =(ConcurrentCompositeStack const&) = delete;
+
+        void push(T const& t)
+        {
+            const Index i = allocate();
+            new (&node(i).storage) T(t);
+
+            while (true) {
+                std::uint32_t depth = 0;
+                if (tryPushTop(i, depth)) {
+                    if (depth >= m_capacity)
+                        spill();
+                    return;
+                }
+
+                if (eliminatePush(i))
+                    return;
+            }
+        }
+
+        /// False if the stack is empty
+        bool tryTake(T & t)
+        {
+            while (true) {
+                Index i = NIL;
+                if (tryPopTop(i))
+                    return i == NIL ? takeFromSubstacks(t) : release(i, t);
+
+                if (eliminateTake(i))
+                    return release(i, t);
+            }
+        }
+
+        T take()
+        {
+            T t;
+            if (!tryTake(t))
+                throw std::logic_error("The compoiste stack is empty.");
+            return t;
+        }
+
+        /// Takes the top of the detached substack
+        T takeAt(std::size_t index)
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(m_stacksMutex);
+            if (index >= m_stacks.size())
+                throw std::logic_error("Cannot take from this stack.");
+
+            auto &&stack = m_stacks[index];
+            std::lock_guard<std::mutex> stackLock(stack.mutex);
+            if (stack.items.empty())
+                throw std::logic_error("Cannot take from this stack.");
+
+            T t = std::move(stack.items.back());
+            stack.items.pop_back();
+            return t;
+        }
+
+        /// Count of detached substacks
+        std::size_t stacksCount() const
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(m_stacksMutex);
+            return m_stacks.size();
+        }
+
+        std::size_t capacity() const { return m_capacity; }
+
+    private:
+        static Tagged tagged(Tagged previous, Index i) { return ((previous >> 32) + 1) << 32 | i; }
+        static Index index(Tagged t) { return Index(t); }
+
+        Node & node(Index i) const
+        {
+            const std::uint64_t n = std::uint64_t(i) + FIRST_SEGMENT;
+            const int segment = 63 - __builtin_clzll(n) - __builtin_ctzll(FIRST_SEGMENT);
+            return m_segments[segment].load(std::memory_order_acquire)[n - (FIRST_SEGMENT << segment)];
+        }
+
+        Index allocate()
+        {
+            Tagged head = m_free.load(std::memory_order_acquire);
+            while (index(head) != NIL) {
+                const Index next = node(index(head)).next.load(std::memory_order_relaxed);
+                if (m_free.compare_exchange_weak(head, tagged(head, next), std::memory_order_acquire,
+                                                 std::memory_order_acquire))
+                    return index(head);
+            }
+
+            const std::uint64_t n = m_allocated.fetch_add(1, std::memory_order_relaxed) + FIRST_SEGMENT;
+            const int segment = 63 - __builtin_clzll(n) - __builtin_ctzll(FIRST_SEGMENT);
+            if (segment >= SEGMENTS_COUNT)
+                throw std::length_error("Too many elements in the concurrent stack.");
+
+            if (!m_segments[segment].load(std::memory_order_acquire)) {
+                std::lock_guard<std::mutex> lock(m_segmentsMutex);
+                if (!m_segments[segment].load(std::memory_order_relaxed))
+                    m_segments[segment].store(new Node[FIRST_SEGMENT << segment](), std::memory_order_release);
+            }
+
+            return Index(n - FIRST_SEGMENT);
+        }
+
+        bool release(Index i, T & t)
+        {
+            t = std::move(node(i).value());
+            node(i).value().~T();
+
+            Tagged head = m_free.load(std::memory_order_relaxed);
+            do {
+                node(i).next.store(index(head), std::memory_order_relaxed);
+            } while (!m_free.compare_exchange_weak(head, tagged(head, i), std::memory_order_release,
+                                                   std::memory_order_relaxed));
+            return true;
+        }
+
+        /// One attempt, false if another thread changed the top
+        bool tryPushTop(Index i, std::uint32_t & depth)
+        {
+            Tagged top = m_top.load(std::memory_order_acquire);
+            depth = index(top) == NIL ? 1 : node(index(top)).depth.load(std::memory_order_relaxed) + 1;
+            node(i).next.store(index(top), std::memory_order_relaxed);
+            node(i).depth.store(depth, std::memory_order_relaxed);
+
+            return m_top.compare_exchange_strong(top, tagged(top, i), std::memory_order_release,
+                                                 std::memory_order_relaxed);
+        }
+
+        /// One attempt, false if another thread changed the top. NIL if the top is empty
+        bool tryPopTop(Index & i)
+        {
+            Tagged top = m_top.load(std::memory_order_acquire);
+            if (index(top) == NIL) {
+                i = NIL;
+                return true;
+            }
+
+            // The node may be taken and reused meanwhile, then the counter doesn't match
+            const Index next = node(index(top)).next.load(std::memory_order_relaxed);
+            if (!m_top.compare_exchange_strong(top, tagged(top, next), std::memory_order_acquire,
+                                               std::memory_order_relaxed))
+                return false;
+
+            i = index(top);
+            return true;
+        }
+
+        Slot & randomSlot()
+        {
+            static thread_local std::minstd_rand generator(
+                unsigned(std::hash<std::thread::id>()(std::this_thread::get_id())));
+            return m_slots[(generator() >> 8) % ELIMINATION_SIZE];
+        }
+
+        bool eliminatePush(Index i)
+        {
+            Slot & slot = randomSlot();
+            std::uint64_t expected = EMPTY;
+            if (!slot.value.compare_exchange_strong(expected, WAITING | i, std::memory_order_release,
+                                                    std::memory_order_relaxed))
+                return false;
+
+            for (int spin = 0; spin < ELIMINATION_SPINS; ++spin) {
+                if (slot.value.load(std::memory_order_acquire) == TAKEN) {
+                    slot.value.store(EMPTY, std::memory_order_release);
+                    return true;
+                }
+            }
+
+            // Nobody came, withdraw the offer unless it is taken right now
+            expected = WAITING | i;
+            if (slot.value.compare_exchange_strong(expected, EMPTY, std::memory_order_relaxed))
+                return false;
+
+            slot.value.store(EMPTY, std::memory_order_release);
+            return true;
+        }
+
+        bool eliminateTake(Index & i)
+        {
+            Slot & slot = randomSlot();
+            for (int spin = 0; spin < ELIMINATION_SPINS; ++spin) {
+                std::uint64_t v = slot.value.load(std::memory_order_acquire);
+                if ((v & (WAITING | TAKEN)) == WAITING &&
+                    slot.value.compare_exchange_strong(v, TAKEN, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                    i = Index(v);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// Detaches the top if it is still full and moves it to the new substack
+        void spill()
+        {
+            std::unique_lock<std::shared_timed_mutex> lock(m_stacksMutex);
+
+            Tagged top = m_top.load(std::memory_order_acquire);
+            do {
+                if (index(top) == NIL || node(index(top)).depth.load(std::memory_order_relaxed) < m_capacity)
+                    return;
+            } while (!m_top.compare_exchange_weak(top, tagged(top, NIL), std::memory_order_acquire,
+                                                  std::memory_order_acquire));
+
+            std::vector<Index> indexes;
+            for (Index i = index(top); i != NIL; i = node(i).next.load(std::memory_order_relaxed))
+                indexes.push_back(i);
+
+            m_stacks.emplace_back();
+            auto &&items = m_stacks.back().items;
+            items.resize(indexes.size());
+            for (std::size_t i = 0; i < indexes.size(); ++i)
+                release(indexes[indexes.size() - 1 - i], items[i]);
+        }
+
+        bool takeFromSubstacks(T & t)
+        {
+            bool taken = false;
+            bool trailingEmpty = false;
+            {
+                std::shared_lock<std::shared_timed_mutex> lock(m_stacksMutex);
+                trailingEmpty = !m_stacks.empty();
+                for (std::size_t i = m_stacks.size(); i-- > 0 && !taken; ) {
+                    auto &&stack = m_stacks[i];
+                    std::lock_guard<std::mutex> stackLock(stack.mutex);
+                    if (!stack.items.empty()) {
+                        t = std::move(stack.items.back());
+                        stack.items.pop_back();
+                        taken = true;
+                        trailingEmpty = i + 1 < m_stacks.size() || stack.items.empty();
+                    }
+                }
+            }
+
+            // Empty substacks on top are removed, so next takes don't visit them
+            if (trailingEmpty) {
+                std::unique_lock<std::shared_timed_mutex> lock(m_stacksMutex);
+                while (!m_stacks.empty() && m_stacks.back().items.empty())
+                    m_stacks.pop_back();
+            }
+            return taken;
+        }
+
+        const std::size_t m_capacity;
+
+        alignas(CACHE_LINE_SIZE) std::atomic<Tagged> m_top {NIL};
+        alignas(CACHE_LINE_SIZE) std::atomic<Tagged> m_free {NIL};
+        Slot m_slots[ELIMINATION_SIZE];
+
+        mutable std::atomic<Node *> m_segments[SEGMENTS_COUNT];
+        std::atomic<std::uint64_t> m_allocated {0};
+        std::mutex m_segmentsMutex;
+
+        mutable std::shared_timed_mutex m_stacksMutex;
+        std::deque<Substack> m_stacks;
+    };
+
+    using IntConcurrentCompositeStack = ConcurrentCompositeStack<int>;
+}
+
+// Implement Queue via two stacks
+namespace tsq
+{
+    template <class T, class Allocator = std::allocator<T>>
+    class Queue
+    {
+    public:
+        explicit Queue(Allocator const& allocator = Allocator())
+            : m_oldest(allocator)
+            , m_newest(allocator)
+        {}
+
+        std::size_t size() const { return m_oldest.size() + m_newest.size(); }
+
+        void add(T const& e)
+        {
+            // Newest stack always has new element on top
+            m_newest.push(e);
+        }
+
+        void add(T && e) { m_newest.push(std::move(e)); }
+
+        template <class... Args>
+        T & emplace(Args &&... args) { return m_newest.emplace(std::forward<Args>(args)...); }
+
+        /// Adds all elements with one insert into the newest stack
+        template <class It>
+        void addRange(It first, It last) { m_newest.pushRange(first, last); }
+
+        /// Moves up to maxCount elements from the front to out, returns the number of moved elements
+        template <class OutIt>
+        std::size_t drain(OutIt out, std::size_t maxCount = std::size_t(-1))
+        {
+            std::size_t count = m_oldest.takeRange(maxCount, out);
+            if (count < maxCount && !m_newest.empty()) {
+                shiftStacks();
+                count += m_oldest.takeRange(maxCount - count, out);
+            }
+            return count;
+        }
+
+        T & peek() { return const_cast<T&>(static_cast<Queue const *>(this)->peek()); }
+        T const& peek() const
+        {
+            shiftStacks();
+            return m_oldest.top();
+        }
+
+        T take()
+        {
+            shiftStacks();
+            return m_oldest.take();
+        }
+
+    private:
+        /// Moves elements from newest stack to oldest. The oldest one is empty, so it is just a swap
+        /// of containers and reversal in place instead of moving elements one by one
+        void shiftStacks() const
+        {
+            if (m_oldest.empty()) {
+                m_oldest.swap(m_newest);
+                m_oldest.reverse();
+            }
+        }
+
+        mutable QStack<T, std::deque<T, Allocator>> m_oldest;
+        mutable QStack<T, std::deque<T, Allocator>> m_newest;
+    };
+
+    using IntQueue = Queue<int>;
+
+    template <class T>
+    using PmrQueue = Queue<T, std::pmr::polymorphic_allocator<T>>;
+
+    namespace details
+    {
+        inline bool isPowerOfTwo(std::size_t n) { return n != 0 && (n & (n - 1)) == 0; }
+    }
+
+    /// Bounded queue for one producer and one consumer. Both sides are wait-free, head and tail
+    /// live on own cache lines and each side keeps a copy of the other index, so it touches the
+    /// shared one only when the queue looks full (empty). add/take spin while full (empty).
+    template <class T>
+    class SpscQueue
+    {
+    public:
+        explicit SpscQueue(std::size_t capacity)
+            : m_mask(capacity - 1)
+            , m_buffer(new Storage[capacity])
+        {
+            if (!details::isPowerOfTwo(capacity))
+                throw std::invalid_argument("Capacity must be a power of two.");
+        }
+
+        ~SpscQueue()
+        {
+            for (std::size_t i = m_head.load(); i != m_tail.load(); ++i)
+                at(i).~T();
+        }
+
+        SpscQueue(SpscQueue const&) = delete;
+        SpscQueue &operator =(SpscQueue const&) = delete;
+
+        /// Approximate if called concurrently
+        std::size_t size() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+        std::size_t capacity() const { return m_mask + 1; }
+
+        /// Producer only
+        bool tryAdd(T const& e)
+        {
+            const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_cachedHead == capacity()) {
+                m_cachedHead = m_head.load(std::memory_order_acquire);
+                if (tail - m_cachedHead == capacity())
+                    return false;
+            }
+
+            new (&m_buffer[tail & m_mask]) T(e);
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        void add(T const& e)
+        {
+            while (!tryAdd(e))
+                std::this_thread::yield();
+        }
+
+        /// Consumer only. Null if the queue is empty
+        T * peek()
+        {
+            const std::size_t head = m_head.load(std::memory_order_relaxed);
+            if (head == m_cachedTail) {
+                m_cachedTail = m_tail.load(std::memory_order_acquire);
+                if (head == m_cachedTail)
+                    return nullptr;
+            }
+
+            return &at(head);
+        }
+
+        /// Consumer only
+        bool tryTake(T & e)
+        {
+            T * front = peek();
+            if (!front)
+                return false;
+
+            e = std::move(*front);
+            front->~T();
+            m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            return true;
+        }
+
+        T take()
+        {
+            T * front = nullptr;
+            while (!(front = peek()))
+                std::this_thread::yield();
+
+            T e = std::move(*front);
+            front->~T();
+            m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            return e;
+        }
+
+    private:
+        using Storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+        T & at(std::size_t i) { return reinterpret_cast<T &>(m_buffer[i & m_mask]); }
+
+        const std::size_t m_mask;
+        std::unique_ptr<Storage[]> m_buffer;
+
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_head {0};
+        std::size_t m_cachedTail = 0;
+
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_tail {0};
+        std::size_t m_cachedHead = 0;
+    };
+
+    /// Bounded queue for many producers and many consumers (D. Vyukov). Every cell has a sequence
+    /// number which tells whose turn it is, so a side competes only for own index with one CAS and
+    /// never waits for the other one. There is no peek: the front may be taken by another consumer.
+    template <class T>
+    class MpmcQueue
+    {
+    public:
+        explicit MpmcQueue(std::size_t capacity)
+            : m_mask(capacity - 1)
+            , m_cells(new Cell[capacity])
+        {
+            if (!details::isPowerOfTwo(capacity))
+                throw std::invalid_argument("Capacity must be a power of two.");
+
+            for (std::size_t i = 0; i < capacity; ++i)
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        ~MpmcQueue()
+        {
+            for (std::size_t i = m_head.load(); i != m_tail.load(); ++i)
+                reinterpret_cast<T &>(m_cells[i & m_mask].storage).~T();
+        }
+
+        MpmcQueue(MpmcQueue const&) = delete;
+        MpmcQueue &operator =(MpmcQueue const&) = delete;
+
+        /// Approximate if called concurrently
+        std::size_t size() const
+        {
+            const std::size_t head = m_head.load(std::memory_order_acquire);
+            const std::size_t tail = m_tail.load(std::memory_order_acquire);
+            return tail > head ? tail - head : 0;
+        }
+
+        std::size_t capacity() const { return m_mask + 1; }
+
+        bool tryAdd(T const& e)
+        {
+            std::size_t tail = m_tail.load(std::memory_order_relaxed);
+            while (true) {
+                Cell &cell = m_cells[tail & m_mask];
+                const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                const std::ptrdiff_t diff = std::ptrdiff_t(sequence) - std::ptrdiff_t(tail);
+
+                if (diff == 0) {
+                    // The cell is free, take the index
+                    if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                        new (&cell.storage) T(e);
+                        cell.sequence.store(tail + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0)
+                    return false; // The cell is not consumed yet, full
+                else
+                    tail = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        void add(T const& e)
+        {
+            while (!tryAdd(e))
+                std::this_thread::yield();
+        }
+
+        bool tryTake(T & e)
+        {
+            std::size_t head = m_head.load(std::memory_order_relaxed);
+            while (true) {
+                Cell &cell = m_cells[head & m_mask];
+                const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                const std::ptrdiff_t diff = std::ptrdiff_t(sequence) - std::ptrdiff_t(head + 1);
+
+                if (diff == 0) {
+                    if (m_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+                        T &value = reinterpret_cast<T &>(cell.storage);
+                        e = std::move(value);
+                        value.~T();
+                        cell.sequence.store(head + capacity(), std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0)
+                    return false; // Nothing is added to the cell yet, empty
+                else
+                    head = m_head.load(std::memory_order_relaxed);
+            }
+        }
+
+        T take()
+        {
+            T e;
+            while (!tryTake(e))
+                std::this_thread::yield();
+            return e;
+        }
+
+    private:
+        struct Cell
+        {
+            std::atomic<std::size_t> sequence;
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        };
+
+        const std::size_t m_mask;
+        std::unique_ptr<Cell[]> m_cells;
+
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_tail {0};
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_head {0};
+    };
+
+    using IntSpscQueue = SpscQueue<int>;
+    using IntMpmcQueue = MpmcQueue<int>;
+}
+
+// Stack and queue with O(1) aggregate (min, max, ...) of all elements
+namespace ag
+{
+    /// Aggregates: value of one element and associative combination of two adjacent ranges, the
+    /// older one first
+    template <class T>
+    struct Min
+    {
+        using Value = T;
+        static Value lift(T const& v) { return v; }
+        static Value combine(Value const& l, Value const& r) { return std::min(l, r); }
+    };
+
+    template <class T>
+    struct Max
+    {
+        using Value = T;
+        static Value lift(T const& v) { return v; }
+        static Value combine(Value const& l, Value const& r) { return std::max(l, r); }
+    };
+
+    template <class T>
+    struct Sum
+    {
+        using Value = T;
+        static Value lift(T const& v) { return v; }
+        static Value combine(Value const& l, Value const& r) { return l + r; }
+    };
+
+    template <class T>
+    struct MinMax
+    {
+        using Value = std::pair<T, T>;
+        static Value lift(T const& v) { return {v, v}; }
+        static Value combine(Value const& l, Value const& r) { return {std::min(l.first, r.first), std::max(l.second, r.second)}; }
+    };
+
+    /// Every element keeps the aggregate of itself and all elements below it
+    template <class T, class Aggregate = Min<T>>
+    class AggregateStack
+    {
+    public:
+        using Value = typename Aggregate::Value;
+
+        std::size_t size() const { return m_stack.size(); }
+        bool empty() const { return m_stack.empty(); }
+
+        T const& top() const { return m_stack.top().first; }
+
+        void push(T const& v) { m_stack.emplace(v, valueWith(v)); }
+
+        void push(T && v)
+        {
+            Value value = valueWith(v);
+            m_stack.emplace(std::move(v), std::move(value));
+        }
+
+        template <class... Args>
+        T const& emplace(Args &&... args)
+        {
+            push(T(std::forward<Args>(args)...));
+            return top();
+        }
+
+        T take() { return std::move(m_stack.take().first); }
+
+        /// Aggregate of all elements from the bottom to the top
+        Value const& aggregate() const
+        {
+            if (empty())
+                throw std::logic_error("No aggregate of an empty stack.");
+            return m_stack.top().second;
+        }
+
+    private:
+        /// Aggregate of the stack after v is pushed
+        Value valueWith(T const& v) const
+        {
+            return empty() ? Aggregate::lift(v) : Aggregate::combine(aggregate(), Aggregate::lift(v));
+        }
+
+        QStack<std::pair<T, Value>> m_stack;
+    };
+
+    /// Queue via two stacks, as tsq::Queue, but both stacks keep aggregates. The newest stack
+    /// aggregates from the bottom (older elements first), the oldest one from the top (the front is
+    /// first), so the aggregate of the queue is one combination. Good for sliding windows.
+    template <class T, class Aggregate = Min<T>>
+    class AggregateQueue
+    {
+    public:
+        using Value = typename Aggregate::Value;
+
+        std::size_t size() const { return m_oldest.size() + m_newest.size(); }
+        bool empty() const { return size() == 0; }
+
+        void add(T const& e) { m_newest.push(e); }
+        void add(T && e) { m_newest.push(std::move(e)); }
+
+        template <class... Args>
+        T const& emplace(Args &&... args) { return m_newest.emplace(std::forward<Args>(args)...); }
+
+        T const& peek()
+        {
+            shiftStacks();
+            return m_oldest.top().first;
+        }
+
+        T take()
+        {
+            shiftStacks();
+            return std::move(m_oldest.take().first);
+        }
+
+        /// Aggregate of all elements from the front to the back, O(1)
+        Value aggregate() const
+        {
+            if (empty())
+                throw std::logic_error("No aggregate of an empty queue.");
+
+            if (m_oldest.empty())
+                return m_newest.aggregate();
+            if (m_newest.empty())
+                return m_oldest.top().second;
+            return Aggregate::combine(m_oldest.top().second, m_newest.aggregate());
+        }
+
+    private:
+        /// Moves elements from newest stack to oldest, each element is moved once
+        void shiftStacks()
+        {
+            if (!m_oldest.empty())
+                return;
+            if (m_newest.empty())
+                throw std::logic_error("The queue is empty.");
+
+            while (!m_newest.empty()) {
+                T v = m_newest.take();
+                Value value = m_oldest.empty() ? Aggregate::lift(v)
+                                               : Aggregate::combine(Aggregate::lift(v), m_oldest.top().second);
+                m_oldest.emplace(std::move(v), std::move(value));
+            }
+        }
+
+        QStack<std::pair<T, Value>> m_oldest;
+        AggregateStack<T, Aggregate> m_newest;
+    };
+
+    using IntMinStack = AggregateStack<int, Min<int>>;
+    using IntMaxStack = AggregateStack<int, Max<int>>;
+    using IntMinMaxQueue = AggregateQueue<int, MinMax<int>>;
+}
+
+// Bounded queue for coroutines: take waits for data, add waits for free space
+namespace aq
+{
+    /// Coroutine started and owned by Executor
+    class Task
+    {
+    public:
+        struct promise_type
+        {
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { exception = std::current_exception(); }
+
+            std::exception_ptr exception;
+        };
+
+        Task(Task && other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+        Task &operator =(Task &&) = delete;
+
+        ~Task()
+        {
+            if (m_handle)
+                m_handle.destroy();
+        }
+
+        std::coroutine_handle<promise_type> release() { return std::exchange(m_handle, nullptr); }
+
+    private:
+        explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    /// Single-threaded executor: resumes ready coroutines one by one until nothing is ready
+    class Executor
+    {
+    public:
+        Executor() = default;
+        Executor(Executor const&) = delete;
+        Executor &operator =(Executor const&) = delete;
+
+        ~Executor()
+        {
+            for (auto && task : m_tasks)
+                task.destroy();
+        }
+
+        void spawn(Task task)
+        {
+            auto handle = task.release();
+            m_tasks.push_back(handle);
+            schedule(handle);
+        }
+
+        void schedule(std::coroutine_handle<> handle) { m_ready.push_back(handle); }
+
+        /// Returns false if some tasks are still waiting, e.g. for a queue nobody adds to.
+        /// Rethrows the first exception of a finished task
+        bool run()
+        {
+            while (!m_ready.empty()) {
+                auto handle = m_ready.front();
+                m_ready.pop_front();
+                handle.resume();
+            }
+
+            std::exception_ptr exception;
+            auto finished = std::partition(m_tasks.begin(), m_tasks.end(), [](auto && t) { return !t.done(); });
+            for (auto it = finished; it != m_tasks.end(); ++it) {
+                if (!exception)
+                    exception = it->promise().exception;
+                it->destroy();
+            }
+            m_tasks.erase(finished, m_tasks.end());
+
+            if (exception)
+                std::rethrow_exception(exception);
+            return m_tasks.empty();
+        }
+
+    private:
+        std::deque<std::coroutine_handle<>> m_ready;
+        std::vector<std::coroutine_handle<Task::promise_type>> m_tasks;
+    };
+
+    /// Bounded FIFO on top of tsq::Queue. Waiting coroutines are served in order: an element
+    /// goes straight to the first waiting taker, free space goes straight to the first waiting
+    /// adder, so the queue never exceeds the capacity and nobody has to poll.
+    template <class T>
+    class BoundedQueue
+    {
+        struct AddAwaiter;
+        struct TakeAwaiter;
+
+    public:
+        BoundedQueue(Executor & executor, std::size_t capacity)
+            : m_executor(executor)
+            , m_capacity(capacity)
+        {
+            if (capacity == 0)
+                throw std::invalid_argument("Capacity must be positive.");
+        }
+
+        std::size_t size() const { return m_queue.size(); }
+        std::size_t capacity() const { return m_capacity; }
+
+        /// co_await queue.add(v) suspends while the queue is full
+        AddAwaiter add(T v) { return AddAwaiter {*this, std::move(v)}; }
+
+        /// co_await queue.take() suspends while the queue is empty
+        TakeAwaiter take() { return TakeAwaiter {*this}; }
+
+    private:
+        struct AddAwaiter
+        {
+            bool await_ready() { return queue.tryAdd(value); }
+
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                handle = h;
+                queue.m_adders.push_back(this);
+            }
+
+            void await_resume() {}
+
+            BoundedQueue & queue;
+            T value;
+            std::coroutine_handle<> handle = nullptr;
+        };
+
+        struct TakeAwaiter
+        {
+            bool await_ready() { return queue.tryTake(result); }
+
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                handle = h;
+                queue.m_takers.push_back(this);
+            }
+
+            T await_resume() { return std::move(*result); }
+
+            BoundedQueue & queue;
+            std::optional<T> result = std::nullopt;
+            std::coroutine_handle<> handle = nullptr;
+        };
+
+        bool tryAdd(T & v)
+        {
+            // Takers wait only if the queue is empty
+            if (!m_takers.empty()) {
+                TakeAwaiter * taker = m_takers.front();
+                m_takers.pop_front();
+                taker->result.emplace(std::move(v));
+                m_executor.schedule(taker->handle);
+                return true;
+            }
+
+            if (m_queue.size() == m_capacity)
+                return false;
+
+            m_queue.add(std::move(v));
+            return true;
+        }
+
+        bool tryTake(std::optional<T> & result)
+        {
+            if (m_queue.size() == 0)
+                return false;
+
+            result.emplace(m_queue.take());
+
+            // Adders wait only if the queue is full
+            if (!m_adders.empty()) {
+                AddAwaiter * adder = m_adders.front();
+                m_adders.pop_front();
+                m_queue.add(std::move(adder->value));
+                m_executor.schedule(adder->handle);
+            }
+            return true;
+        }
+
+        Executor & m_executor;
+        std::size_t m_capacity;
+        tsq::Queue<T> m_queue;
+        std::deque<AddAwaiter *> m_adders;
+        std::deque<TakeAwaiter *> m_takers;
+    };
+}
+
+// Implement sorted stack with using two stacks. Here it is a heap, the smallest element is on top
+namespace ss
+{
+    /// d-ary heap in a vector. A node has D children in a row, so they are usually in one cache
+    /// line and the tree is log(D) times lower than the binary one. Push and take are O(log n).
+    template <class T, std::size_t D = 4, class Compare = std::less<T>, class Allocator = std::allocator<T>>
+    class SortedStack
+    {
+        static_assert(D >= 2, "Heap must have at least two children per node.");
+
+    public:
+        explicit SortedStack(Compare const& compare = Compare(), Allocator const& allocator = Allocator())
+            : m_heap(allocator)
+            , m_compare(compare)
+        {}
+
+        explicit SortedStack(Allocator const& allocator) : SortedStack(Compare(), allocator) {}
+
+        T const & peek() const
+        {
+            if (empty())
+                throw std::logic_error("The sorted stack is empty.");
+            return m_heap.front();
+        }
+
+        T take()
+        {
+            if (empty())
+                throw std::logic_error("The sorted stack is empty.");
+
+            T v = std::move(m_heap.front());
+            if (m_heap.size() > 1)
+                m_heap.front() = std::move(m_heap.back());
+            m_heap.pop_back();
+
+            if (!m_heap.empty())
+                siftDown(0);
+            return v;
+        }
+
+        void push(T const& v) { emplace(v); }
+        void push(T && v) { emplace(std::move(v)); }
+
+        template <class... Args>
+        void emplace(Args &&... args)
+        {
+            m_heap.emplace_back(std::forward<Args>(args)...);
+            siftUp(m_heap.size() - 1);
+        }
+
+        /// Appends all elements and restores the heap bottom-up, O(n) for the whole heap
+        template <class It>
+        void pushRange(It first, It last)
+        {
+            m_heap.insert(m_heap.end(), first, last);
+            if (m_heap.size() < 2)
+                return;
+
+            for (std::size_t i = parent(m_heap.size() - 1) + 1; i-- > 0; )
+                siftDown(i);
+        }
+
+        bool empty() const { return m_heap.empty(); }
+        std::size_t size() const { return m_heap.size(); }
+
+    private:
+        static std::size_t parent(std::size_t i) { return (i - 1) / D; }
+
+        // Moves the hole instead of swapping, one move per level
+        void siftUp(std::size_t i)
+        {
+            T v = std::move(m_heap[i]);
+            while (i > 0 && m_compare(v, m_heap[parent(i)])) {
+                m_heap[i] = std::move(m_heap[parent(i)]);
+                i = parent(i);
+            }
+            m_heap[i] = std::move(v);
+        }
+
+        void siftDown(std::size_t i)
+        {
+            const std::size_t size = m_heap.size();
+            T v = std::move(m_heap[i]);
+            while (true) {
+                const std::size_t first = D * i + 1;
+                if (first >= size)
+                    break;
+
+                std::size_t best = first;
+                const std::size_t last = std::min(first + D, size);
+                for (std::size_t c = first + 1; c < last; ++c)
+                    if (m_compare(m_heap[c], m_heap[best]))
+                        best = c;
+
+                if (!m_compare(m_heap[best], v))
+                    break;
+
+                m_heap[i] = std::move(m_heap[best]);
+                i = best;
+            }
+            m_heap[i] = std::move(v);
+        }
+
+        std::vector<T, Allocator> m_heap;
+        Compare m_compare;
+    };
+
+    using IntStack = SortedStack<int>;
+
+    template <class T, std::size_t D = 4, class Compare = std::less<T>>
+    using PmrSortedStack = SortedStack<T, D, Compare, std::pmr::polymorphic_allocator<T>>;
+}
+
+// Animal shelter. Implement functions to "adopt" the oldest animal (in general) or perticulat animal
+// (i.e. dog or cat).
+namespace as
+{
+    /// Ring buffer which doubles when full, elements of one category are contiguous
+    template <class T>
+    class RingBuffer
+    {
+    public:
+        bool empty() const { return m_size == 0; }
+        std::size_t size() const { return m_size; }
+
+        T & front() { return m_buffer[m_head]; }
+        T const & front() const { return m_buffer[m_head]; }
+
+        void pushBack(T const& v)
+        {
+            if (m_size == m_buffer.size())
+                grow();
+
+            m_buffer[(m_head + m_size) & (m_buffer.size() - 1)] = v;
+            ++m_size;
+        }
+
+        T takeFront()
+        {
+            T v = std::move(m_buffer[m_head]);
+            m_head = (m_head + 1) & (m_buffer.size() - 1);
+            --m_size;
+            return v;
+        }
+
+    private:
+        void grow()
+        {
+            std::vector<T> buffer(m_buffer.empty() ? 16 : 2 * m_buffer.size());
+            for (std::size_t i = 0; i < m_size; ++i)
+                buffer[i] = std::move(m_buffer[(m_head + i) & (m_buffer.size() - 1)]);
+
+            m_buffer.swap(buffer);
+            m_head = 0;
+        }
+
+        std::vector<T> m_buffer;
+        std::size_t m_head = 0;
+        std::size_t m_size = 0;
+    };
+
+    /// FIFO of items of several categories. Every item gets a sequence number of the queue, the
+    /// oldest item is found by a tournament (winner) tree over the heads of the categories, so
+    /// dequeueAny is O(log K). dequeueWeighted serves categories round-robin, up to weight items
+    /// of a category in a row (deficit round-robin).
+    template <class T>
+    class MultiQueue
+    {
+    public:
+        explicit MultiQueue(std::size_t categories)
+            : m_queues(categories)
+            , m_weights(categories, 1)
+            , m_current(categories - 1)
+        {
+            if (categories == 0)
+                throw std::invalid_argument("There must be at least one category.");
+
+            while (m_leaves < categories)
+                m_leaves *= 2;
+
+            // Leaves are categories, the rest of leaves never win
+            m_tree.assign(2 * m_leaves, NONE);
+            for (std::size_t c = 0; c < categories; ++c)
+                m_tree[m_leaves + c] = c;
+        }
+
+        std::size_t categories() const { return m_queues.size(); }
+        std::size_t size() const { return m_size; }
+        bool empty() const { return m_size == 0; }
+        std::size_t size(std::size_t category) const { return m_queues.at(category).size(); }
+
+        void setWeight(std::size_t category, std::size_t weight)
+        {
+            if (weight == 0)
+                throw std::invalid_argument("Weight must be positive.");
+            m_weights.at(category) = weight;
+        }
+
+        void enqueue(std::size_t category, T const& item)
+        {
+            auto &&queue = m_queues.at(category);
+            queue.pushBack({m_counter++, item});
+            ++m_size;
+
+            // Items of a category are ordered, only a new head can change the winner
+            if (queue.size() == 1)
+                replay(category);
+        }
+
+        /// The oldest item of all categories
+        T dequeueAny()
+        {
+            if (empty())
+                throw std::logic_error("The queue is empty.");
+            return dequeue(m_tree[1]);
+        }
+
+        /// Category of the oldest item
+        std::size_t oldestCategory() const
+        {
+            if (empty())
+                throw std::logic_error("The queue is empty.");
+            return m_tree[1];
+        }
+
+        T dequeue(std::size_t category)
+        {
+            auto &&queue = m_queues.at(category);
+            if (queue.empty())
+                throw std::logic_error("No items of this category.");
+
+            T item = queue.takeFront().second;
+            --m_size;
+            replay(category);
+            return item;
+        }
+
+        /// Categories take turns, each one gives up to its weight items per turn
+        T dequeueWeighted()
+        {
+            if (empty())
+                throw std::logic_error("The queue is empty.");
+
+            while (m_credit == 0 || m_queues[m_current].empty()) {
+                m_current = (m_current + 1) % m_queues.size();
+                m_credit = m_weights[m_current];
+            }
+
+            --m_credit;
+            return dequeue(m_current);
+        }
+
+    private:
+        using Sequence = std::uint64_t;
+        using Entry = std::pair<Sequence, T>;
+
+        static const std::size_t NONE = std::size_t(-1);
+
+        Sequence head(std::size_t category) const
+        {
+            if (category == NONE || m_queues[category].empty())
+                return std::numeric_limits<Sequence>::max();
+            return m_queues[category].front().first;
+        }
+
+        /// Plays the matches on the way from the leaf of the category to the root
+        void replay(std::size_t category)
+        {
+            for (std::size_t i = (m_leaves + category) / 2; i > 0; i /= 2) {
+                std::size_t l = m_tree[2 * i], r = m_tree[2 * i + 1];
+                m_tree[i] = head(r) < head(l) ? r : l;
+            }
+        }
+
+        std::vector<RingBuffer<Entry>> m_queues;
+        std::vector<std::size_t> m_weights;
+        std::vector<std::size_t> m_tree;
+        std::size_t m_leaves = 1;
+
+        Sequence m_counter = 0;
+        std::size_t m_size = 0;
+
+        // Turn of the weighted dequeue, the first one goes to the category 0
+        std::size_t m_current;
+        std::size_t m_credit = 0;
+    };
+
+    template <class T>
+    const std::size_t MultiQueue<T>::NONE;
+
+    struct Animal
+    {
+        std::string name;
+
+        // Easy one, we don't have any behavioural difference between dogs and cats in this model
+        enum Type { Dog, Cat, TypesCount };
+        Type type;
+    };
+
+    class AnimalQueue
+    {
+    public:
+        AnimalQueue() : m_animals(Animal::TypesCount) {}
+
+        void enqueue(Animal const& animal) { m_animals.enqueue(animal.type, animal); }
+
+        /// The oldest animal
+        Animal dequeueAny()
+        {
+            if (m_animals.empty())
+                throw std::logic_error("No animals of this type or at all.");
+            return m_animals.dequeueAny();
+        }
+
+        /// The oldest animal of the type
+        Animal dequeueDog() { return dequeueImpl(Animal::Dog); }
+        Animal dequeueCat() { return dequeueImpl(Animal::Cat); }
+
+    private:
+        Animal dequeueImpl(Animal::Type type)
+        {
+            if (m_animals.size(type) == 0)
+                throw std::logic_error("No animals of this type or at all.");
+            return m_animals.dequeue(type);
+        }
+
+        MultiQueue<Animal> m_animals;
+    };
+
+    inline void print(Animal const& animal)
+    {
+        std::cout << animal.name
+                  << "\t"
+                  << (animal.type == Animal::Dog ? "dog" : "cat") << std::endl;
+    }
+}
@@ -1,6 +1,9 @@
 TEMPLATE = app
-CONFIG += console c++14
+CONFIG += console c++2a thread
 CONFIG -= app_bundle
 CONFIG -= qt
 
 SOURCES += main.cpp
+
+HEADERS += \
+    stacks.h